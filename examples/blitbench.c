@@ -0,0 +1,125 @@
+/* Alpha blending throughput: omc blit kernels against SDL_BlitSurface.
+ * usage: blitbench [image.png] [iterations] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "../src/blit.h"
+
+#define BENCH_WIDTH  1280
+#define BENCH_HEIGHT 720
+#define BENCH_DEPTH  32
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* a gradient with every alpha value, plus opaque and transparent bands */
+static SDL_Surface *
+source_create (int w, int h)
+{
+  SDL_Surface *srf;
+  int x, y;
+
+  srf = SDL_CreateRGBSurface (SDL_SWSURFACE | SDL_SRCALPHA, w, h, 32,
+                              0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+  if (!srf)
+    return NULL;
+
+  for (y = 0; y < h; y++)
+  {
+    Uint32 *p = (Uint32 *) ((Uint8 *) srf->pixels + y * srf->pitch);
+
+    for (x = 0; x < w; x++)
+    {
+      Uint32 a = (y < h / 4) ? 0 : (y < h / 2) ? 255 : (x * 255 / w);
+      p[x] = (a << 24) | ((x & 0xff) << 16) | ((y & 0xff) << 8) | 0x40;
+    }
+  }
+
+  return srf;
+}
+
+static void
+bench (const char *name, SDL_Surface *src, SDL_Surface *dst, int sdl, int n)
+{
+  double t;
+  long pixels = 0;
+  int i;
+
+  t = now ();
+  for (i = 0; i < n; i++)
+  {
+    SDL_Rect d = { (i * 7) % 64, (i * 3) % 32, 0, 0 };
+
+    if (sdl)
+      SDL_BlitSurface (src, NULL, dst, &d);
+    else
+      blit_alpha (src, NULL, dst, &d);
+    pixels += d.w * d.h;
+  }
+  t = now () - t;
+
+  printf ("%-8s %8.1f Mpixel/s\n", name, pixels / t / 1000000.0);
+}
+
+int
+main (int argc, char **argv)
+{
+  SDL_Surface *display, *img, *src;
+  blit_impl_t impl;
+  int n = 200;
+
+  SDL_putenv ("SDL_VIDEODRIVER=dummy");
+  if (SDL_Init (SDL_INIT_VIDEO) < 0)
+  {
+    fprintf (stderr, "*** ERROR: SDL_Init: %s\n", SDL_GetError ());
+    return 1;
+  }
+
+  display = SDL_SetVideoMode (BENCH_WIDTH, BENCH_HEIGHT, BENCH_DEPTH,
+                              SDL_SWSURFACE);
+  if (!display)
+  {
+    fprintf (stderr, "*** ERROR: SDL_SetVideoMode: %s\n", SDL_GetError ());
+    SDL_Quit ();
+    return 1;
+  }
+
+  img = (argc > 1) ? IMG_Load (argv[1])
+    : source_create (BENCH_WIDTH - 64, BENCH_HEIGHT - 32);
+  if (argc > 2)
+    n = atoi (argv[2]);
+  if (!img)
+  {
+    fprintf (stderr, "*** ERROR: can't load source image\n");
+    SDL_Quit ();
+    return 1;
+  }
+
+  /* the same format as omc widgets */
+  src = SDL_DisplayFormatAlpha (img);
+  SDL_FreeSurface (img);
+
+  printf ("%d blits of %dx%d\n", n, src->w, src->h);
+  bench ("SDL", src, display, 1, n);
+  for (impl = BLIT_IMPL_SCALAR; impl <= BLIT_IMPL_AVX2; impl++)
+  {
+    if (blit_init (impl) < 0)
+      continue;
+    bench (blit_impl_name (), src, display, 0, n);
+  }
+
+  SDL_FreeSurface (src);
+  SDL_Quit ();
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+/* Peak memory of image loading: whole image decoding, as SDL_image
+ * does, against omc streamed PNG decoding. Run once per mode, as the
+ * peak is per process.
+ * usage: pngbench whole|stream image.png [width height] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "../src/scale.h"
+#include "../src/decode.h"
+#include "../src/pool.h"
+
+static long
+peak_rss (void)
+{
+  struct rusage ru;
+
+  getrusage (RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+/* what image_load() used to do for every file */
+static SDL_Surface *
+load_whole (char *filename, int w, int h)
+{
+  SDL_Surface *img, *img2;
+
+  img = IMG_Load (filename);
+  if (!img)
+    return NULL;
+
+  img2 = SDL_DisplayFormatAlpha (img);
+  SDL_FreeSurface (img);
+  if (!img2)
+    return NULL;
+  img = img2;
+
+  if (w > 0 && h > 0 && (w != img->w || h != img->h))
+  {
+    img2 = scale_surface (img, w, h, SCALE_BILINEAR);
+    SDL_FreeSurface (img);
+    img = img2;
+  }
+
+  return img;
+}
+
+int
+main (int argc, char **argv)
+{
+  SDL_Surface *img;
+  int w = 1280, h = 720;
+
+  if (argc < 3)
+  {
+    fprintf (stderr, "usage: %s whole|stream image.png [width height]\n",
+             argv[0]);
+    return 1;
+  }
+  if (argc > 4)
+  {
+    w = atoi (argv[3]);
+    h = atoi (argv[4]);
+  }
+
+  SDL_putenv ("SDL_VIDEODRIVER=dummy");
+  if (SDL_Init (SDL_INIT_VIDEO) < 0
+      || !SDL_SetVideoMode (w, h, 32, SDL_SWSURFACE))
+  {
+    fprintf (stderr, "*** ERROR: SDL: %s\n", SDL_GetError ());
+    return 1;
+  }
+
+  pool_init (0);
+  scale_init (BLIT_IMPL_AUTO);
+
+  if (!strcmp (argv[1], "stream"))
+    img = decode_png (argv[2], w, h, SCALE_BILINEAR);
+  else
+    img = load_whole (argv[2], w, h);
+  if (!img)
+  {
+    fprintf (stderr, "*** ERROR: can't load %s\n", argv[2]);
+    return 1;
+  }
+
+  printf ("%-6s %dx%d: peak RSS %ld kB\n",
+          argv[1], img->w, img->h, peak_rss ());
+
+  SDL_FreeSurface (img);
+  pool_uninit ();
+  SDL_Quit ();
+
+  return 0;
+}
@@ -0,0 +1,146 @@
+/* Image scaling time: omc resampler against SDL_gfx zoomSurface.
+ * usage: scalebench [image.png|-] [threads] [iterations]
+ * "-" or no image scales a generated 1920x1080 source. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_rotozoom.h>
+
+#include "../src/scale.h"
+#include "../src/pool.h"
+
+#define SOURCE_WIDTH  1920
+#define SOURCE_HEIGHT 1080
+
+static const struct {
+  int w, h;
+} sizes[] = {
+  { 1280, 720 },        /* backgrounds */
+  { 600, 480 },         /* menu pictures */
+};
+
+static const char *filter_names[] = { "box", "bilinear", "lanczos3", "fast" };
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static SDL_Surface *
+source_create (int w, int h)
+{
+  SDL_Surface *srf;
+  int x, y;
+
+  srf = SDL_CreateRGBSurface (SDL_SWSURFACE | SDL_SRCALPHA, w, h, 32,
+                              0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+  if (!srf)
+    return NULL;
+
+  for (y = 0; y < h; y++)
+  {
+    Uint32 *p = (Uint32 *) ((Uint8 *) srf->pixels + y * srf->pitch);
+
+    for (x = 0; x < w; x++)
+      p[x] = 0xff000000 | ((x ^ y) & 0xff) << 16 | (x & 0xff) << 8 | (y & 0xff);
+  }
+
+  return srf;
+}
+
+/* average time in ms */
+static double
+bench (SDL_Surface *src, int w, int h, int filter, int n)
+{
+  double t;
+  int i;
+
+  t = now ();
+  for (i = 0; i < n; i++)
+  {
+    SDL_Surface *dst;
+
+    if (filter < 0)
+      dst = zoomSurface (src, (float) w / src->w, (float) h / src->h, 1);
+    else
+      dst = scale_surface (src, w, h, filter);
+    SDL_FreeSurface (dst);
+  }
+
+  return (now () - t) * 1000.0 / n;
+}
+
+int
+main (int argc, char **argv)
+{
+  SDL_Surface *img, *src;
+  blit_impl_t impl;
+  int threads = 1, n = 10;
+  int s, f;
+
+  if (argc > 2)
+    threads = atoi (argv[2]);
+  if (argc > 3)
+    n = atoi (argv[3]);
+
+  SDL_putenv ("SDL_VIDEODRIVER=dummy");
+  if (SDL_Init (SDL_INIT_VIDEO) < 0)
+  {
+    fprintf (stderr, "*** ERROR: SDL_Init: %s\n", SDL_GetError ());
+    return 1;
+  }
+
+  if (!SDL_SetVideoMode (SOURCE_WIDTH, SOURCE_HEIGHT, 32, SDL_SWSURFACE))
+  {
+    fprintf (stderr, "*** ERROR: SDL_SetVideoMode: %s\n", SDL_GetError ());
+    SDL_Quit ();
+    return 1;
+  }
+
+  img = (argc > 1 && strcmp (argv[1], "-")) ? IMG_Load (argv[1])
+    : source_create (SOURCE_WIDTH, SOURCE_HEIGHT);
+  if (!img)
+  {
+    fprintf (stderr, "*** ERROR: can't load source image\n");
+    SDL_Quit ();
+    return 1;
+  }
+
+  /* what image_load() scales */
+  src = SDL_DisplayFormatAlpha (img);
+  SDL_FreeSurface (img);
+
+  pool_init (threads - 1);
+
+  for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+  {
+    printf ("%dx%d -> %dx%d, %d thread(s)\n",
+            src->w, src->h, sizes[s].w, sizes[s].h, threads);
+    printf ("  %-20s %8.2f ms\n", "zoomSurface",
+            bench (src, sizes[s].w, sizes[s].h, -1, n));
+
+    for (impl = BLIT_IMPL_SCALAR; impl <= BLIT_IMPL_AVX2; impl++)
+    {
+      if (scale_init (impl) < 0)
+        continue;
+
+      for (f = SCALE_BOX; f <= SCALE_FAST; f++)
+        printf ("  %-8s %-11s %8.2f ms\n", filter_names[f],
+                scale_impl_name (), bench (src, sizes[s].w, sizes[s].h, f, n));
+    }
+  }
+
+  pool_uninit ();
+  SDL_FreeSurface (src);
+  SDL_Quit ();
+
+  return 0;
+}
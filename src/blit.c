@@ -0,0 +1,362 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <SDL.h>
+
+#include "config.h"
+#include "blit.h"
+
+#if defined (HAVE_SSE2) || defined (HAVE_AVX2)
+#include <immintrin.h>
+#endif
+
+/* Every kernel computes, for the three colour bytes of each pixel,
+ *   t = s * a + d * (255 - a) + 128
+ *   r = (t + (t >> 8)) >> 8
+ * which is s * a / 255 correctly rounded, so that a = 0 leaves the
+ * destination as is and a = 255 copies the source. The alpha byte of
+ * the destination is kept. All implementations give identical results. */
+
+#define BLIT_AMASK 0xff000000
+
+typedef void (*blend_row_t) (const Uint32 *src, Uint32 *dst, int w);
+
+static void
+blend_row_scalar (const Uint32 *src, Uint32 *dst, int w)
+{
+  int i;
+
+  for (i = 0; i < w; i++)
+  {
+    Uint32 s = src[i], d = dst[i];
+    Uint32 a = s >> 24;
+    Uint32 rb, g;
+
+    if (a == 0)
+      continue;
+    if (a == 255)
+    {
+      dst[i] = (s & ~BLIT_AMASK) | (d & BLIT_AMASK);
+      continue;
+    }
+
+    /* blend red and blue at once, 16 bits apart */
+    rb = (s & 0xff00ff) * a + (d & 0xff00ff) * (255 - a) + 0x800080;
+    rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+
+    g = ((s >> 8) & 0xff) * a + ((d >> 8) & 0xff) * (255 - a) + 0x80;
+    g = ((g + (g >> 8)) >> 8) & 0xff;
+
+    dst[i] = rb | (g << 8) | (d & BLIT_AMASK);
+  }
+}
+
+#ifdef HAVE_SSE2
+__attribute__ ((target ("sse2"))) static inline __m128i
+blend_sse2 (__m128i s, __m128i d)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i half = _mm_set1_epi16 (0x80);
+  const __m128i inv = _mm_set1_epi16 (0xff);
+  /* drop the alpha lanes so that t = d * 255 + 128 there, i.e. d */
+  const __m128i rgb = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+  __m128i res[2];
+  int k;
+
+  for (k = 0; k < 2; k++)
+  {
+    __m128i s16, d16, a, t;
+
+    s16 = k ? _mm_unpackhi_epi8 (s, zero) : _mm_unpacklo_epi8 (s, zero);
+    d16 = k ? _mm_unpackhi_epi8 (d, zero) : _mm_unpacklo_epi8 (d, zero);
+
+    a = _mm_shufflelo_epi16 (s16, 0xff);
+    a = _mm_shufflehi_epi16 (a, 0xff);
+    a = _mm_and_si128 (a, rgb);
+
+    t = _mm_add_epi16 (_mm_mullo_epi16 (s16, a),
+                       _mm_mullo_epi16 (d16, _mm_xor_si128 (a, inv)));
+    t = _mm_add_epi16 (t, half);
+    t = _mm_add_epi16 (t, _mm_srli_epi16 (t, 8));
+    res[k] = _mm_srli_epi16 (t, 8);
+  }
+
+  return _mm_packus_epi16 (res[0], res[1]);
+}
+
+__attribute__ ((target ("sse2"))) static void
+blend_row_sse2 (const Uint32 *src, Uint32 *dst, int w)
+{
+  const __m128i amask = _mm_set1_epi32 (BLIT_AMASK);
+  int i;
+
+  for (i = 0; i + 4 <= w; i += 4)
+  {
+    __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i d, sa;
+    int m;
+
+    /* fully transparent and fully opaque runs are frequent */
+    sa = _mm_and_si128 (s, amask);
+    m = _mm_movemask_epi8 (_mm_cmpeq_epi32 (sa, _mm_setzero_si128 ()));
+    if (m == 0xffff)
+      continue;
+
+    d = _mm_loadu_si128 ((__m128i *) (dst + i));
+    m = _mm_movemask_epi8 (_mm_cmpeq_epi32 (sa, amask));
+    if (m == 0xffff)
+      d = _mm_or_si128 (_mm_andnot_si128 (amask, s), _mm_and_si128 (d, amask));
+    else
+      d = blend_sse2 (s, d);
+    _mm_storeu_si128 ((__m128i *) (dst + i), d);
+  }
+
+  blend_row_scalar (src + i, dst + i, w - i);
+}
+#endif /* HAVE_SSE2 */
+
+#ifdef HAVE_AVX2
+__attribute__ ((target ("avx2"))) static inline __m256i
+blend_avx2 (__m256i s, __m256i d)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i half = _mm256_set1_epi16 (0x80);
+  const __m256i inv = _mm256_set1_epi16 (0xff);
+  const __m256i rgb = _mm256_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1,
+                                        0, -1, -1, -1, 0, -1, -1, -1);
+  __m256i res[2];
+  int k;
+
+  /* unpack/pack work per 128 bits lane, so the pixel order is kept */
+  for (k = 0; k < 2; k++)
+  {
+    __m256i s16, d16, a, t;
+
+    s16 = k ? _mm256_unpackhi_epi8 (s, zero) : _mm256_unpacklo_epi8 (s, zero);
+    d16 = k ? _mm256_unpackhi_epi8 (d, zero) : _mm256_unpacklo_epi8 (d, zero);
+
+    a = _mm256_shufflelo_epi16 (s16, 0xff);
+    a = _mm256_shufflehi_epi16 (a, 0xff);
+    a = _mm256_and_si256 (a, rgb);
+
+    t = _mm256_add_epi16 (_mm256_mullo_epi16 (s16, a),
+                          _mm256_mullo_epi16 (d16, _mm256_xor_si256 (a, inv)));
+    t = _mm256_add_epi16 (t, half);
+    t = _mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8));
+    res[k] = _mm256_srli_epi16 (t, 8);
+  }
+
+  return _mm256_packus_epi16 (res[0], res[1]);
+}
+
+__attribute__ ((target ("avx2"))) static void
+blend_row_avx2 (const Uint32 *src, Uint32 *dst, int w)
+{
+  const __m256i amask = _mm256_set1_epi32 (BLIT_AMASK);
+  int i;
+
+  for (i = 0; i + 8 <= w; i += 8)
+  {
+    __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i d, sa;
+    int m;
+
+    sa = _mm256_and_si256 (s, amask);
+    m = _mm256_movemask_epi8 (_mm256_cmpeq_epi32 (sa, _mm256_setzero_si256 ()));
+    if (m == -1)
+      continue;
+
+    d = _mm256_loadu_si256 ((__m256i *) (dst + i));
+    m = _mm256_movemask_epi8 (_mm256_cmpeq_epi32 (sa, amask));
+    if (m == -1)
+      d = _mm256_or_si256 (_mm256_andnot_si256 (amask, s),
+                           _mm256_and_si256 (d, amask));
+    else
+      d = blend_avx2 (s, d);
+    _mm256_storeu_si256 ((__m256i *) (dst + i), d);
+  }
+
+  blend_row_scalar (src + i, dst + i, w - i);
+}
+#endif /* HAVE_AVX2 */
+
+static blend_row_t blend_row = blend_row_scalar;
+static blit_impl_t blend_impl = BLIT_IMPL_SCALAR;
+
+static const char *impl_names[] = {
+  [BLIT_IMPL_AUTO]   = "auto",
+  [BLIT_IMPL_SCALAR] = "scalar",
+  [BLIT_IMPL_SSE2]   = "sse2",
+  [BLIT_IMPL_AVX2]   = "avx2",
+};
+
+static blend_row_t
+blit_lookup (blit_impl_t impl)
+{
+  switch (impl)
+  {
+  case BLIT_IMPL_SCALAR:
+    return blend_row_scalar;
+#ifdef HAVE_SSE2
+  case BLIT_IMPL_SSE2:
+    return __builtin_cpu_supports ("sse2") ? blend_row_sse2 : NULL;
+#endif
+#ifdef HAVE_AVX2
+  case BLIT_IMPL_AVX2:
+    return __builtin_cpu_supports ("avx2") ? blend_row_avx2 : NULL;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+/* must be called before any other thread may blit */
+int
+blit_init (blit_impl_t impl)
+{
+  blend_row_t fn;
+
+  if (impl == BLIT_IMPL_AUTO)
+  {
+    for (impl = BLIT_IMPL_AVX2; impl > BLIT_IMPL_SCALAR; impl--)
+      if (blit_lookup (impl))
+        break;
+  }
+
+  fn = blit_lookup (impl);
+  if (!fn)
+    return -1;
+
+  blend_row = fn;
+  blend_impl = impl;
+
+  return 0;
+}
+
+const char *
+blit_impl_name (void)
+{
+  return impl_names[blend_impl];
+}
+
+static int
+blit_supported (SDL_Surface *src, SDL_Surface *dst)
+{
+  SDL_PixelFormat *sf = src->format;
+  SDL_PixelFormat *df = dst->format;
+
+  /* RLE encoded surfaces have no usable pixels */
+  if (SDL_MUSTLOCK (src) || SDL_MUSTLOCK (dst))
+    return 0;
+
+  if ((src->flags & (SDL_SRCALPHA | SDL_SRCCOLORKEY)) != SDL_SRCALPHA)
+    return 0;
+
+  if (sf->BytesPerPixel != 4 || df->BytesPerPixel != 4)
+    return 0;
+
+  if (sf->Amask != BLIT_AMASK || (sf->Rmask | sf->Gmask | sf->Bmask) != ~BLIT_AMASK)
+    return 0;
+
+  /* colour bytes must be at the same place, whatever their order */
+  return (sf->Rmask == df->Rmask && sf->Gmask == df->Gmask
+          && sf->Bmask == df->Bmask);
+}
+
+int
+blit_alpha (SDL_Surface *src, SDL_Rect *srcrect,
+            SDL_Surface *dst, SDL_Rect *dstrect)
+{
+  SDL_Rect *clip;
+  int sx, sy, dx, dy, w, h, d;
+  Uint8 *sp, *dp;
+
+  if (!src || !dst || !blit_supported (src, dst))
+    return -1;
+
+  /* same clipping rules as SDL_UpperBlit() */
+  if (srcrect)
+  {
+    sx = srcrect->x;
+    sy = srcrect->y;
+    w = srcrect->w;
+    h = srcrect->h;
+  }
+  else
+  {
+    sx = sy = 0;
+    w = src->w;
+    h = src->h;
+  }
+  dx = dstrect ? dstrect->x : 0;
+  dy = dstrect ? dstrect->y : 0;
+
+  if (sx < 0)
+  {
+    w += sx;
+    dx -= sx;
+    sx = 0;
+  }
+  if (sx + w > src->w)
+    w = src->w - sx;
+  if (sy < 0)
+  {
+    h += sy;
+    dy -= sy;
+    sy = 0;
+  }
+  if (sy + h > src->h)
+    h = src->h - sy;
+
+  clip = &dst->clip_rect;
+  if ((d = clip->x - dx) > 0)
+  {
+    w -= d;
+    sx += d;
+    dx = clip->x;
+  }
+  if ((d = dx + w - clip->x - clip->w) > 0)
+    w -= d;
+  if ((d = clip->y - dy) > 0)
+  {
+    h -= d;
+    sy += d;
+    dy = clip->y;
+  }
+  if ((d = dy + h - clip->y - clip->h) > 0)
+    h -= d;
+
+  if (w <= 0 || h <= 0)
+    w = h = 0;
+
+  if (dstrect)
+  {
+    dstrect->x = dx;
+    dstrect->y = dy;
+    dstrect->w = w;
+    dstrect->h = h;
+  }
+
+  sp = (Uint8 *) src->pixels + sy * src->pitch + sx * 4;
+  dp = (Uint8 *) dst->pixels + dy * dst->pitch + dx * 4;
+  for (; h > 0; h--, sp += src->pitch, dp += dst->pitch)
+    blend_row ((const Uint32 *) sp, (Uint32 *) dp, w);
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _BLIT_H_
+#define _BLIT_H_
+
+#include <SDL.h>
+
+typedef enum {
+  BLIT_IMPL_AUTO,
+  BLIT_IMPL_SCALAR,
+  BLIT_IMPL_SSE2,
+  BLIT_IMPL_AVX2,
+} blit_impl_t;
+
+int blit_init (blit_impl_t impl);
+const char *blit_impl_name (void);
+
+/* per-pixel alpha blit of an ARGB surface onto an xRGB one, destination
+ * alpha is left untouched; returns -1 when the formats are not handled,
+ * in which case the caller should fall back to SDL_BlitSurface() */
+int blit_alpha (SDL_Surface *src, SDL_Rect *srcrect,
+                SDL_Surface *dst, SDL_Rect *dstrect);
+
+#endif /* _BLIT_H_ */
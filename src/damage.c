@@ -0,0 +1,163 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <SDL.h>
+
+#include "damage.h"
+#include "widgets/widget.h"
+#include "display.h"
+#include "stats.h"
+
+static inline Uint32
+rect_area (SDL_Rect *r)
+{
+  return (Uint32) r->w * r->h;
+}
+
+/* overlapping or adjacent rectangles */
+static int
+rect_touch (SDL_Rect *r1, SDL_Rect *r2)
+{
+  return (r1->x <= r2->x + r2->w) && (r2->x <= r1->x + r1->w)
+    && (r1->y <= r2->y + r2->h) && (r2->y <= r1->y + r1->h);
+}
+
+static Uint32
+rect_shared (SDL_Rect *r1, SDL_Rect *r2)
+{
+  int w, h;
+
+  w = MIN (r1->x + r1->w, r2->x + r2->w) - MAX (r1->x, r2->x);
+  h = MIN (r1->y + r1->h, r2->y + r2->h) - MAX (r1->y, r2->y);
+
+  return (w > 0 && h > 0) ? (Uint32) w * h : 0;
+}
+
+/* number of pixels that would be pushed for nothing if r1 and r2
+ * were presented through their bounding box */
+static Uint32
+rect_waste (SDL_Rect *r1, SDL_Rect *r2)
+{
+  SDL_Rect u = rect_union (r1, r2);
+  Uint32 used = rect_area (r1) + rect_area (r2) - rect_shared (r1, r2);
+
+  return rect_area (&u) - used;
+}
+
+void
+damage_reset (damage_t *dmg)
+{
+  if (dmg)
+    dmg->nb = 0;
+}
+
+void
+damage_add (damage_t *dmg, SDL_Rect *r)
+{
+  SDL_Rect cur;
+  int i;
+
+  if (!dmg || !r || !r->w || !r->h)
+    return;
+
+  cur = *r;
+
+  /* merge with every touching rectangle as long as it costs less than
+   * the merged rectangles themselves, restarting after each merge as the
+   * grown rectangle may now touch previously skipped ones */
+  for (i = 0; i < dmg->nb; i++)
+  {
+    SDL_Rect *d = &dmg->rects[i];
+
+    if (!rect_touch (&cur, d))
+      continue;
+
+    if (rect_waste (&cur, d) > MIN (rect_area (&cur), rect_area (d)))
+      continue;
+
+    cur = rect_union (&cur, d);
+    dmg->rects[i] = dmg->rects[--dmg->nb];
+    i = -1;
+  }
+
+  if (dmg->nb < DAMAGE_MAX_RECTS)
+  {
+    dmg->rects[dmg->nb++] = cur;
+    return;
+  }
+
+  /* list is full: grow the rectangle that wastes the fewest pixels */
+  {
+    Uint32 best_waste = (Uint32) -1;
+    int best = 0;
+
+    for (i = 0; i < dmg->nb; i++)
+    {
+      Uint32 waste = rect_waste (&cur, &dmg->rects[i]);
+      if (waste < best_waste)
+      {
+        best_waste = waste;
+        best = i;
+      }
+    }
+
+    dmg->rects[best] = rect_union (&cur, &dmg->rects[best]);
+  }
+}
+
+Uint32
+damage_area (damage_t *dmg)
+{
+  Uint32 area = 0;
+  int i;
+
+  if (!dmg)
+    return 0;
+
+  for (i = 0; i < dmg->nb; i++)
+    area += rect_area (&dmg->rects[i]);
+
+  return area;
+}
+
+void
+damage_present (damage_t *dmg, SDL_Surface *display)
+{
+  Uint32 screen;
+
+  if (!dmg || !display || !dmg->nb)
+    return;
+
+  screen = (Uint32) display->w * display->h;
+
+  /* double buffered displays can only be flipped as a whole */
+  if ((display->flags & SDL_DOUBLEBUF) == SDL_DOUBLEBUF
+      || damage_area (dmg) * 100 > screen * DAMAGE_FLIP_THRESHOLD)
+  {
+    SDL_Flip (display);
+    STATS_ADD (STATS_PRESENT_FLIPS, 1);
+  }
+  else
+  {
+    SDL_UpdateRects (display, dmg->nb, dmg->rects);
+    STATS_ADD (STATS_PRESENT_RECTS, dmg->nb);
+  }
+
+  damage_reset (dmg);
+}
@@ -0,0 +1,40 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _DAMAGE_H_
+#define _DAMAGE_H_
+
+#include <SDL.h>
+
+#define DAMAGE_MAX_RECTS 32
+
+/* percentage of the screen above which a full flip is cheaper */
+#define DAMAGE_FLIP_THRESHOLD 60
+
+typedef struct damage_s {
+  SDL_Rect rects[DAMAGE_MAX_RECTS];
+  int nb;
+} damage_t;
+
+void damage_reset (damage_t *dmg);
+void damage_add (damage_t *dmg, SDL_Rect *r);
+Uint32 damage_area (damage_t *dmg);
+void damage_present (damage_t *dmg, SDL_Surface *display);
+
+#endif /* _DAMAGE_H_ */
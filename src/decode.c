@@ -0,0 +1,197 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#include "config.h"
+#include "decode.h"
+
+#ifdef HAVE_PNG
+#include <png.h>
+
+/* Rows are read from the file, converted and scaled one at a time,
+ * straight into the final surface. Apart from it only a few rows are
+ * allocated, where IMG_Load(), SDL_DisplayFormatAlpha() and scaling
+ * need up to three whole images at once. Interlaced files can't be
+ * read by rows and are left to SDL_image. */
+
+/* a 32 bits surface in the pixel order SDL_DisplayFormatAlpha() picks */
+static SDL_Surface *
+surface_new (int w, int h)
+{
+  SDL_Surface *video = SDL_GetVideoSurface ();
+  Uint32 rmask = 0x00ff0000, bmask = 0x000000ff;
+
+  if (video)
+  {
+    SDL_PixelFormat *vf = video->format;
+
+    if ((vf->BytesPerPixel == 2 && vf->Rmask == 0x1f
+         && (vf->Bmask == 0xf800 || vf->Bmask == 0x7c00))
+        || (vf->BytesPerPixel >= 3 && vf->Rmask == 0xff
+            && vf->Bmask == 0xff0000))
+    {
+      rmask = 0x000000ff;
+      bmask = 0x00ff0000;
+    }
+  }
+
+  return SDL_CreateRGBSurface (SDL_SWSURFACE, w, h, 32,
+                               rmask, 0x0000ff00, bmask, 0xff000000);
+}
+
+/* R, G, B, A bytes to pixels, in place */
+static void
+row_convert (Uint8 *row, int w, SDL_PixelFormat *fmt)
+{
+  Uint32 *p = (Uint32 *) row;
+  int x;
+
+  for (x = 0; x < w; x++, row += 4)
+    p[x] = row[0] << fmt->Rshift | row[1] << fmt->Gshift
+      | row[2] << fmt->Bshift | (Uint32) row[3] << fmt->Ashift;
+}
+
+SDL_Surface *
+decode_png (char *filename, int w, int h, scale_filter_t filter)
+{
+  SDL_Surface *volatile dst = NULL;
+  scale_stream_t *volatile stream = NULL;
+  png_structp png;
+  png_infop info = NULL;
+  png_uint_32 pw, ph, y;
+  int depth, type, interlace;
+  Uint8 sig[8];
+  FILE *f;
+
+  if (!filename)
+    return NULL;
+
+  f = fopen (filename, "rb");
+  if (!f)
+    return NULL;
+
+  if (fread (sig, 1, sizeof (sig), f) != sizeof (sig)
+      || png_sig_cmp (sig, 0, sizeof (sig)))
+  {
+    fclose (f);
+    return NULL;
+  }
+
+  png = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (png)
+    info = png_create_info_struct (png);
+  if (!info)
+  {
+    png_destroy_read_struct (&png, NULL, NULL);
+    fclose (f);
+    return NULL;
+  }
+
+  if (setjmp (png_jmpbuf (png)))
+  {
+    fprintf (stderr, "*** ERROR: can't decode %s\n", filename);
+    scale_stream_free (stream);
+    SDL_FreeSurface (dst);
+    png_destroy_read_struct (&png, &info, NULL);
+    fclose (f);
+    return NULL;
+  }
+
+  png_init_io (png, f);
+  png_set_sig_bytes (png, sizeof (sig));
+  png_read_info (png, info);
+  png_get_IHDR (png, info, &pw, &ph, &depth, &type, &interlace, NULL, NULL);
+
+  if (interlace != PNG_INTERLACE_NONE)
+  {
+    png_destroy_read_struct (&png, &info, NULL);
+    fclose (f);
+    return NULL;
+  }
+
+  /* whatever the file holds, rows come as 8 bits R, G, B and A */
+  if (type == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb (png);
+  if (type == PNG_COLOR_TYPE_GRAY && depth < 8)
+    png_set_expand_gray_1_2_4_to_8 (png);
+  if (png_get_valid (png, info, PNG_INFO_tRNS))
+    png_set_tRNS_to_alpha (png);
+  if (depth == 16)
+    png_set_strip_16 (png);
+  if (type == PNG_COLOR_TYPE_GRAY || type == PNG_COLOR_TYPE_GRAY_ALPHA)
+    png_set_gray_to_rgb (png);
+  png_set_filler (png, 0xff, PNG_FILLER_AFTER);
+  png_read_update_info (png, info);
+
+  if (w <= 0 || h <= 0)
+  {
+    w = pw;
+    h = ph;
+  }
+
+  /* the scalar kernels are slower than SDL_gfx, see image_decode() */
+  if ((w != pw || h != ph) && !scale_accelerated ())
+  {
+    png_destroy_read_struct (&png, &info, NULL);
+    fclose (f);
+    return NULL;
+  }
+
+  dst = surface_new (w, h);
+  if (!dst)
+    png_error (png, "out of memory");
+
+  if (w != pw || h != ph)
+  {
+    stream = scale_stream_new (pw, ph, dst, filter);
+    if (!stream)
+      png_error (png, "out of memory");
+  }
+
+  for (y = 0; y < ph; y++)
+  {
+    Uint8 *row = stream ? scale_stream_row (stream)
+      : (Uint8 *) dst->pixels + y * dst->pitch;
+
+    png_read_row (png, row, NULL);
+    row_convert (row, pw, dst->format);
+    if (stream)
+      scale_stream_push (stream);
+  }
+
+  png_read_end (png, NULL);
+  png_destroy_read_struct (&png, &info, NULL);
+  fclose (f);
+  scale_stream_free (stream);
+
+  return dst;
+}
+
+#else
+
+SDL_Surface *
+decode_png (char *filename, int w, int h, scale_filter_t filter)
+{
+  return NULL;
+}
+
+#endif /* HAVE_PNG */
@@ -0,0 +1,33 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+#include <SDL.h>
+
+#include "scale.h"
+
+/* decodes and scales a PNG image one row at a time, into a 32 bits
+ * surface with alpha in the format SDL_DisplayFormatAlpha() gives;
+ * returns NULL if the file can't be streamed, e.g. is not a PNG */
+SDL_Surface *decode_png (char *filename, int w, int h,
+                         scale_filter_t filter);
+
+#endif /* _DECODE_H_ */
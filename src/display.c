@@ -17,31 +17,162 @@
  *
  */
 
+#include <string.h>
 #include <SDL.h>
 #include <SDL_thread.h>
 
 #include "omc.h"
 #include "display.h"
+#include "damage.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "pool.h"
+#include "blit.h"
 #include "screens/screen.h"
 #include "widgets/widget.h"
 
-#define TICK_INTERVAL 100 /* (10 fps = 1000 / 100ms) */
+#define TILE_W 128
+#define TILE_H 64
+#define TILES_MIN 4 /* serial composition is cheaper for smaller damages */
 
-static Uint32 next_time;
+typedef struct draw_item_s {
+  widget_t *widget;
+  SDL_Rect area;        /* visible part of the widget to be drawn */
+} draw_item_t;
 
-static Uint32
-time_left (void)
+/* current frame composition, owned by the display thread */
+typedef struct frame_s {
+  draw_item_t *items;   /* from back to front */
+  int nb_items;
+  int items_size;
+  SDL_Rect *tiles;      /* disjoint screen tiles covering the damage */
+  int nb_tiles;
+  Uint8 *marks;         /* damaged grid cells */
+  int tiles_size;
+} frame_t;
+
+static damage_t damage; /* screen areas blitted during current frame */
+static frame_t frame;
+static int blit_prepare;
+
+/* frame scheduling */
+static SDL_mutex *frame_lock;
+static SDL_mutex *render_lock;  /* held while widget surfaces are read */
+static SDL_cond *frame_cond;
+static int frame_pending;
+static int quit;                /* display thread has to return */
+static int dump_requested;
+static Uint32 display_thread;
+
+/* animated widgets, see display_animate() */
+typedef struct ticker_s {
+  widget_t *widget;
+  Uint32 due;           /* next frame of the animation */
+} ticker_t;
+
+static ticker_t *tickers;       /* under the render lock */
+static int nb_tickers;
+static int tickers_size;
+static int tick_pending;        /* owned by the display thread */
+static Uint32 tick_next;
+
+int
+rect_intersect (SDL_Rect *r1, SDL_Rect *r2, SDL_Rect *area)
 {
-  Uint32 now;
+  int x, y, w, h;
 
-  now = SDL_GetTicks ();
-  if (next_time <= now)
-  {
-    next_time = now;
+  x = MAX (r1->x, r2->x);
+  y = MAX (r1->y, r2->y);
+  w = MIN (r1->x + r1->w, r2->x + r2->w) - x;
+  h = MIN (r1->y + r1->h, r2->y + r2->h) - y;
+
+  if (w <= 0 || h <= 0)
     return 0;
+
+  if (area)
+  {
+    area->x = x;
+    area->y = y;
+    area->w = w;
+    area->h = h;
   }
 
-  return next_time - now;
+  return 1;
+}
+
+SDL_Rect
+rect_union (SDL_Rect *r1, SDL_Rect *r2)
+{
+  SDL_Rect u;
+
+  /* empty rectangles do not extend anything */
+  if (!r1->w || !r1->h)
+    return *r2;
+  if (!r2->w || !r2->h)
+    return *r1;
+
+  u.x = MIN (r1->x, r2->x);
+  u.y = MIN (r1->y, r2->y);
+  u.w = MAX (r1->x + r1->w, r2->x + r2->w) - u.x;
+  u.h = MAX (r1->y + r1->h, r2->y + r2->h) - u.y;
+
+  return u;
+}
+
+/* Splits what cover leaves visible of r in up to 4 parts: full width
+ * bands above and below cover, then what remains on its sides.
+ * Parts are only counted when parts is NULL.
+ * Returns the number of parts. */
+int
+rect_subtract (SDL_Rect *r, SDL_Rect *cover, SDL_Rect *parts)
+{
+  SDL_Rect in, p[4];
+  int i, n = 0;
+
+  if (!rect_intersect (r, cover, &in))
+  {
+    if (parts)
+      parts[0] = *r;
+    return 1;
+  }
+
+  if (in.y > r->y) /* top band */
+  {
+    p[n].x = r->x;
+    p[n].y = r->y;
+    p[n].w = r->w;
+    p[n++].h = in.y - r->y;
+  }
+
+  if (in.y + in.h < r->y + r->h) /* bottom band */
+  {
+    p[n].x = r->x;
+    p[n].y = in.y + in.h;
+    p[n].w = r->w;
+    p[n++].h = r->y + r->h - in.y - in.h;
+  }
+
+  if (in.x > r->x) /* left side */
+  {
+    p[n].x = r->x;
+    p[n].y = in.y;
+    p[n].w = in.x - r->x;
+    p[n++].h = in.h;
+  }
+
+  if (in.x + in.w < r->x + r->w) /* right side */
+  {
+    p[n].x = in.x + in.w;
+    p[n].y = in.y;
+    p[n].w = r->x + r->w - in.x - in.w;
+    p[n++].h = in.h;
+  }
+
+  if (parts)
+    for (i = 0; i < n; i++)
+      parts[i] = p[i];
+
+  return n;
 }
 
 int
@@ -61,81 +192,431 @@ compute_coord (char *coord, int max)
 }
 
 int
-surface_blit (widget_t *widget, SDL_Surface *srf, SDL_Rect offset)
+surface_blit (widget_t *widget, SDL_Surface *srf, SDL_Rect offset,
+              SDL_Rect *area)
 {
-  if (!widget || !srf)
+  SDL_Rect dst, src;
+
+  if (!widget || !srf || !area)
     return -1;
 
-  if (SDL_MUSTLOCK (omc->display))
-    SDL_LockSurface (omc->display);
+  /* have SDL map the surface to the display, but blit nothing */
+  if (blit_prepare)
+  {
+    SDL_Rect none = { 0, 0, 0, 0 };
+    SDL_LowerBlit (srf, &none, omc->display, &none);
+    return 0;
+  }
+
+  /* only blit what the compositor asked for ... */
+  dst = *area;
 
-  if(widget->parent) {
-    SDL_Rect area;
-    widget_share_area (widget, widget->parent, &area);
-    SDL_SetClipRect (omc->display, &area);
+  /* ... and what remains visible through the parent */
+  if (widget->parent)
+  {
+    SDL_Rect r = widget_get_rect (widget->parent);
+    if (!rect_intersect (&dst, &r, &dst))
+      return 0;
   }
 
-  if (widget->redraw_area.x != 0)
+  src.x = dst.x - offset.x;
+  src.y = dst.y - offset.y;
+  src.w = dst.w;
+  src.h = dst.h;
+
+  /* SDL locks the display by itself, it must not be locked here */
+  if (blit_alpha (srf, &src, omc->display, &dst) < 0)
+    SDL_BlitSurface (srf, &src, omc->display, &dst);
+  STATS_PIXELS (widget->layer, dst.w * dst.h);
+
+  return 0;
+}
+
+static void
+frame_add_item (widget_t *widget, SDL_Rect *area)
+{
+  if (frame.nb_items == frame.items_size)
   {
-    offset.x = widget->redraw_area.x - widget->x;
-    offset.y = widget->redraw_area.y - widget->y;
-    offset.w = widget->redraw_area.w;
-    offset.h = widget->redraw_area.h;
+    frame.items_size = frame.items_size ? 2 * frame.items_size : 32;
+    frame.items =
+      realloc (frame.items, frame.items_size * sizeof (draw_item_t));
+  }
+
+  frame.items[frame.nb_items].widget = widget;
+  frame.items[frame.nb_items].area = *area;
+  frame.nb_items++;
+}
 
-    SDL_BlitSurface (srf, &offset,
-                     omc->display, &(widget->redraw_area));
-    SDL_mutexP (widget->lock);
-    widget->redraw_area.x = 0;
-    widget->redraw_area.y = 0;
-    widget->redraw_area.w = 0;
-    widget->redraw_area.h = 0;
-    SDL_mutexV (widget->lock);
+/* Splits damaged areas into disjoint tiles from a fixed grid.
+ * Returns the number of tiles. */
+static int
+frame_split_tiles (void)
+{
+  int cols, rows, i, x, y;
+
+  cols = (omc->display->w + TILE_W - 1) / TILE_W;
+  rows = (omc->display->h + TILE_H - 1) / TILE_H;
+
+  if (cols * rows > frame.tiles_size)
+  {
+    frame.tiles_size = cols * rows;
+    frame.tiles = realloc (frame.tiles, frame.tiles_size * sizeof (SDL_Rect));
+    frame.marks = realloc (frame.marks, frame.tiles_size);
   }
-  else
-    SDL_BlitSurface (srf, NULL, omc->display, &offset);
+  memset (frame.marks, 0, cols * rows);
 
-  if(widget->parent)
-    SDL_SetClipRect (omc->display, NULL);
+  for (i = 0; i < damage.nb; i++)
+  {
+    SDL_Rect *d = &damage.rects[i];
+    int c0, c1, r0, r1;
 
-  if (SDL_MUSTLOCK (omc->display))
-    SDL_UnlockSurface (omc->display);
+    c0 = MAX (d->x, 0) / TILE_W;
+    r0 = MAX (d->y, 0) / TILE_H;
+    c1 = MIN ((d->x + d->w - 1) / TILE_W, cols - 1);
+    r1 = MIN ((d->y + d->h - 1) / TILE_H, rows - 1);
 
-  return 0;
+    for (y = r0; y <= r1; y++)
+      for (x = c0; x <= c1; x++)
+        frame.marks[y * cols + x] = 1;
+  }
+
+  frame.nb_tiles = 0;
+  for (y = 0; y < rows; y++)
+    for (x = 0; x < cols; x++)
+      if (frame.marks[y * cols + x])
+      {
+        SDL_Rect *t = &frame.tiles[frame.nb_tiles++];
+
+        t->x = x * TILE_W;
+        t->y = y * TILE_H;
+        t->w = MIN (TILE_W, omc->display->w - t->x);
+        t->h = MIN (TILE_H, omc->display->h - t->y);
+      }
+
+  return frame.nb_tiles;
+}
+
+/* draws, in order, every item part falling into the tile */
+static void
+frame_compose_tile (void *data, int index)
+{
+  SDL_Rect *tile = &frame.tiles[index];
+  int i;
+
+  for (i = 0; i < frame.nb_items; i++)
+  {
+    SDL_Rect r;
+
+    if (rect_intersect (&frame.items[i].area, tile, &r))
+      widget_draw (frame.items[i].widget, &r);
+  }
+}
+
+/* Tiles are disjoint and each of them replays the items in the same
+ * order as the serial path, which makes both outputs identical. */
+static void
+frame_compose (void)
+{
+  int i;
+
+  if (pool_threads () && !SDL_MUSTLOCK (omc->display)
+      && frame_split_tiles () >= TILES_MIN)
+  {
+    /* surfaces mapping is not thread safe, have it done beforehand */
+    blit_prepare = 1;
+    for (i = 0; i < frame.nb_items; i++)
+      if (!widget_draw (frame.items[i].widget, &frame.items[i].area))
+        STATS_ADD (STATS_WIDGETS_DRAWN, 1);
+    blit_prepare = 0;
+
+    pool_run (frame_compose_tile, NULL, frame.nb_tiles);
+    return;
+  }
+
+  for (i = 0; i < frame.nb_items; i++)
+    if (!widget_draw (frame.items[i].widget, &frame.items[i].area))
+      STATS_ADD (STATS_WIDGETS_DRAWN, 1);
+}
+
+/* Widgets swap their surface pointer first, then take the render lock
+ * before freeing the old surface: once they get it, no frame being
+ * composed can still be reading from it. */
+void
+display_lock (void)
+{
+  if (render_lock)
+    SDL_mutexP (render_lock);
+}
+
+void
+display_unlock (void)
+{
+  if (render_lock)
+    SDL_mutexV (render_lock);
+}
+
+void
+display_wakeup (void)
+{
+  if (!frame_lock)
+    return;
+
+  /* animations are ticked right before dirty widgets are collected */
+  if (SDL_ThreadID () == display_thread)
+    return;
+
+  SDL_mutexP (frame_lock);
+  if (!frame_pending)
+  {
+    frame_pending = 1;
+    SDL_CondSignal (frame_cond);
+  }
+  SDL_mutexV (frame_lock);
+}
+
+void
+display_request_dump (void)
+{
+  if (!frame_lock)
+    return;
+
+  SDL_mutexP (frame_lock);
+  dump_requested = 1;
+  frame_pending = 1;
+  SDL_CondSignal (frame_cond);
+  SDL_mutexV (frame_lock);
+}
+
+/* Animated widgets get their tick callback called by the display thread,
+ * which returns when their next frame is due. The display thread sleeps
+ * until then if nothing else has to be drawn. */
+void
+display_animate (widget_t *widget, int state)
+{
+  int i;
+
+  if (!widget || !widget->tick)
+    return;
+
+  display_lock ();
+  for (i = 0; i < nb_tickers; i++)
+    if (tickers[i].widget == widget)
+      break;
+
+  if (!state && i < nb_tickers)
+    tickers[i] = tickers[--nb_tickers];
+  else if (state && i == nb_tickers)
+  {
+    if (nb_tickers == tickers_size)
+    {
+      tickers_size = tickers_size ? 2 * tickers_size : 8;
+      tickers = realloc (tickers, tickers_size * sizeof (ticker_t));
+    }
+    tickers[nb_tickers].widget = widget;
+    tickers[nb_tickers].due = SDL_GetTicks ();
+    nb_tickers++;
+  }
+  display_unlock ();
+
+  /* first frame is due right now */
+  if (state)
+    display_wakeup ();
+}
+
+/* Advances the animations that are due, the ones having a new frame
+ * invalidate their own rect. Caller holds the render lock. */
+static void
+display_tick (Uint32 now)
+{
+  int i;
+
+  tick_pending = nb_tickers;
+  for (i = 0; i < nb_tickers; i++)
+  {
+    ticker_t *t = &tickers[i];
+
+    if ((Sint32) (t->due - now) <= 0)
+      t->due = t->widget->tick (t->widget, now);
+
+    if (!i || (Sint32) (t->due - tick_next) < 0)
+      tick_next = t->due;
+  }
+}
+
+/* Sleeps until something has to be drawn, or the next animation frame.
+ * Returns whether current frame has to be dumped, -1 to quit. */
+static int
+display_wait (void)
+{
+  int dump;
+
+  SDL_mutexP (frame_lock);
+  while (!frame_pending && !quit)
+  {
+    Sint32 delay;
+
+    if (!tick_pending)
+    {
+      SDL_CondWait (frame_cond, frame_lock);
+      continue;
+    }
+
+    delay = tick_next - SDL_GetTicks ();
+    if (delay <= 0 || SDL_CondWaitTimeout (frame_cond, frame_lock, delay)
+        == SDL_MUTEX_TIMEDOUT)
+      break;
+  }
+  frame_pending = 0;
+  dump = quit ? -1 : dump_requested;
+  dump_requested = 0;
+  SDL_mutexV (frame_lock);
+
+  return dump;
+}
+
+/* frame dumping and headless runs termination */
+static void
+display_frame_done (int drawn, int dump)
+{
+  int last;
+
+  if (drawn)
+    omc->frames++;
+
+  /* startup time, i.e. decoding or mapping the screen images */
+  if (drawn && omc->frames == 1)
+    printf ("First frame after %u ms\n", SDL_GetTicks ());
+
+  last = drawn && omc->max_frames && omc->frames == omc->max_frames;
+
+  /* every frame when named after its number, else only the last one */
+  if (drawn && omc->dump && strstr (omc->dump, "%d"))
+    dump = 1;
+  if (last && (omc->dump || omc->dump_hash))
+    dump = 1;
+
+  if (dump)
+    snapshot_dump (omc->display, omc->dump, omc->frames, omc->dump_hash);
+
+  if (last)
+  {
+    SDL_Event ev;
+
+    ev.type = SDL_QUIT;
+    SDL_PushEvent (&ev);
+  }
 }
 
 static int
 display_handler (void *data)
 {
-  next_time = SDL_GetTicks() + TICK_INTERVAL;
-  
+  widget_t **draw_list = NULL;
+  int draw_size = 0;
+  Uint32 next_time = 0;
+
+  display_thread = SDL_ThreadID ();
+
   while (1)
   {
+    uint64_t t0 = 0, t1 = 0;
+    Uint32 now;
+    int n = 0, dump;
+
+    dump = display_wait ();
+    if (dump < 0)
+      break;
+
+    /* do not go faster than the max frame rate, e.g. during animations */
+    now = SDL_GetTicks ();
+    if (omc->max_fps && (Sint32) (next_time - now) > 0)
+    {
+      SDL_Delay (next_time - now);
+      now = SDL_GetTicks ();
+    }
+    if (omc->max_fps)
+      next_time = now + 1000 / omc->max_fps;
+
+    if (stats_enabled)
+      t0 = stats_time ();
+
     /* update screen composition (i.e. blit surfaces) */
+    SDL_mutexP (render_lock);
+    display_tick (now);
     if (omc->scr)
     {
-      widget_t **widgets;
-      int depth;
+      SDL_Rect parts[SCREEN_MAX_PARTS];
+      int i, j, nb;
+
+      /* dirty widgets only, already sorted from back to front */
+      n = screen_collect_dirty (omc->scr, &draw_list, &draw_size);
+      frame.nb_items = 0;
+      for (i = 0; i < n; i++)
+      {
+        widget_t *widget = draw_list[i];
+
+        /* skip what opaque widgets from upper layers will hide anyway */
+        nb = screen_visible_parts (omc->scr, widget,
+                                   &widget->draw_area, parts);
+        if (!nb && widget->draw_area.w && widget->draw_area.h)
+          STATS_ADD (STATS_WIDGETS_OCCLUDED, 1);
+
+        for (j = 0; j < nb; j++)
+        {
+          frame_add_item (widget, &parts[j]);
+          damage_add (&damage, &parts[j]);
+        }
+      }
+
+      if (frame.nb_items)
+        frame_compose ();
+    }
+    SDL_mutexV (render_lock);
 
-      for (depth = 0; depth < MAX_DEPTH; depth++)
-        for (widgets = omc->scr->wlist; *widgets; widgets++)
-          if ((*widgets)->layer == depth)
-            widget_draw (*widgets);
-    }    
+    if (stats_enabled)
+      t1 = stats_time ();
 
-    /* flip screen for double buffering */
-    SDL_Flip (omc->display);
+    /* only push the areas that have been blitted */
+    damage_present (&damage, omc->display);
 
-    /* wait for next interval */
-    SDL_Delay (time_left ());
-    next_time += TICK_INTERVAL;
+    if (stats_enabled && n)
+      stats_frame (t1 - t0, stats_time () - t1);
+
+    display_frame_done (n > 0, dump);
   }
 
+  free (draw_list);
+
   return 0;
 }
 
 void
 create_display_thread (void)
+{
+  if (omc->dth)
+    return;
+
+  frame_lock = SDL_CreateMutex ();
+  render_lock = SDL_CreateMutex ();
+  frame_cond = SDL_CreateCond ();
+  frame_pending = 1;
+
+  omc->dth = SDL_CreateThread (display_handler, NULL);
+}
+
+/* The display thread returns once done with the current frame, it must
+ * not be killed while holding the render lock. Locks are kept, timers
+ * may still take them until they are removed. */
+void
+destroy_display_thread (void)
 {
   if (!omc->dth)
-    omc->dth = SDL_CreateThread (display_handler, NULL);
+    return;
+
+  SDL_mutexP (frame_lock);
+  quit = 1;
+  SDL_CondSignal (frame_cond);
+  SDL_mutexV (frame_lock);
+
+  SDL_WaitThread (omc->dth, NULL);
+  omc->dth = NULL;
 }
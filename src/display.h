@@ -22,8 +22,26 @@
 
 #define MAX_DEPTH 8 /* 0 is farest from screen, typically background */
 
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef MIN
+#define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+int rect_intersect (SDL_Rect *r1, SDL_Rect *r2, SDL_Rect *area);
+SDL_Rect rect_union (SDL_Rect *r1, SDL_Rect *r2);
+int rect_subtract (SDL_Rect *r, SDL_Rect *cover, SDL_Rect *parts);
 int compute_coord (char *coord, int max);
-int surface_blit (widget_t *widget, SDL_Surface *srf, SDL_Rect offset);
+int surface_blit (widget_t *widget, SDL_Surface *srf, SDL_Rect offset,
+                  SDL_Rect *area);
+void display_lock (void);
+void display_unlock (void);
+void display_wakeup (void);
+void display_animate (widget_t *widget, int state);
+void display_request_dump (void);
 void create_display_thread (void);
+void destroy_display_thread (void);
 
 #endif /* _DISPLAY_H_ */
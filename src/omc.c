@@ -18,18 +18,31 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 #include <SDL.h>
 #include <SDL_ttf.h>
 
 #include "omc.h"
 #include "event.h"
 #include "display.h"
+#include "stats.h"
+#include "pool.h"
+#include "blit.h"
 #include "widgets/widget.h"
+#include "widgets/cache.h"
+#include "widgets/loader.h"
+#include "widgets/pack.h"
+#include "widgets/font.h"
 #include "screens/screen.h"
 
 #define DEFAULT_WIDTH  1280
 #define DEFAULT_HEIGHT 720
 #define DEFAULT_DEPTH  24
+#define HEADLESS_DEPTH 32
+#define DEFAULT_MAX_FPS 60
 #define DEFAULT_WM_CAPTION "GeeXboX Open Media Center"
 
 void
@@ -39,23 +52,102 @@ omc_init (void)
   omc->display = NULL;
   omc->scr = NULL;
   omc->dth = NULL;
+  omc->sth = NULL;
   omc->w = DEFAULT_WIDTH;
   omc->h = DEFAULT_HEIGHT;
+  omc->max_fps = DEFAULT_MAX_FPS;
+  omc->filter = SCALE_FAST;
+  omc->pack = NULL;
+  omc->threads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (omc->threads < 1)
+    omc->threads = 1;
+  omc->headless = 0;
+  omc->max_frames = 0;
+  omc->frames = 0;
+  omc->dump = NULL;
+  omc->dump_hash = 0;
 }
 
 void
 omc_uninit (void)
 {
-  if (omc->dth)
-    SDL_KillThread (omc->dth);
+  /* before anything the display thread may still be drawing goes */
+  destroy_display_thread ();
+  if (omc->sth)
+    SDL_KillThread (omc->sth);
+  pool_uninit ();
+
+  /* bake what is still cached, all the screen images at least */
+  if (omc->pack && pack_stale ())
+    pack_write (omc->pack);
+
   if (omc->scr)
     screen_uninit (omc->scr);
+  widget_budget_uninit ();
+  loader_uninit ();
+  cache_uninit ();
+  pack_close ();
 
+  stats_uninit ();
+  paragraph_uninit ();
+  font_uninit ();
   TTF_Quit ();
   SDL_Quit ();
   free (omc);
 }
 
+static sigset_t signals;
+
+/* signals are blocked in all threads and handled here, where it is safe
+ * to wake the display thread up */
+static int
+signal_handler (void *data)
+{
+  int sig;
+
+  while (1)
+  {
+    if (sigwait (&signals, &sig))
+      continue;
+
+    if (sig == SIGUSR1)
+      display_request_dump ();
+    else if (sig == SIGUSR2)
+      stats_dump ();
+  }
+
+  return 0;
+}
+
+static void
+usage (char *name)
+{
+  printf ("Usage: %s [options]\n", name);
+  printf ("  -c MB       decoded images cache size [%d]\n",
+          CACHE_DEFAULT_BUDGET >> 20);
+  printf ("  -f fps      maximum frame rate, 0 for none [%d]\n",
+          DEFAULT_MAX_FPS);
+  printf ("  -g WxH      screen resolution [%dx%d]\n",
+          DEFAULT_WIDTH, DEFAULT_HEIGHT);
+  printf ("  -j threads  compositing threads [number of CPUs]\n");
+  printf ("  -m MB       widgets surface memory, hidden ones unload over it "
+          "[%d]\n", WIDGET_DEFAULT_BUDGET >> 20);
+  printf ("  -p file     images pack, baked on exit when missing or outdated\n");
+  printf ("  -r filter   images resampling: fast, box, bilinear, lanczos3, "
+          "the last\n"
+          "              three smoothing when shrinking [fast]\n");
+  printf ("  -H          headless, render offscreen with no display\n");
+  printf ("  -n frames   quit after that many frames, dumping the last one\n");
+  printf ("  -o file     save dumped frames to PPM file, each frame is\n"
+          "              dumped when file contains %%d (frame number)\n");
+  printf ("  -x          print a hash of dumped frames\n");
+  printf ("  -s file     collect rendering stats, dumped to file ('-' for\n"
+          "              stdout) on exit and on SIGUSR2\n");
+  printf ("  -S          collect rendering stats, shown on screen\n");
+  printf ("  -h          display this help\n");
+  printf ("Sending SIGUSR1 dumps the current frame.\n");
+}
+
 int
 main (int argc, char **argv)
 {
@@ -65,8 +157,89 @@ main (int argc, char **argv)
   SDL_Rect **modes;
   SDL_Event event;
   Uint32 bpp;
+  char *stats_output = NULL;
+  size_t cache_size = CACHE_DEFAULT_BUDGET;
+  size_t widget_size = WIDGET_DEFAULT_BUDGET;
+  int depth, c, stats = 0, overlay = 0;
 
   omc_init ();
+
+  while ((c = getopt (argc, argv, "c:f:g:j:m:p:r:Hn:o:xs:Sh")) != -1)
+  {
+    switch (c)
+    {
+    case 'c':
+      cache_size = (size_t) MAX (atoi (optarg), 0) << 20;
+      break;
+    case 'f':
+      omc->max_fps = atoi (optarg);
+      if (omc->max_fps < 0)
+        omc->max_fps = 0;
+      break;
+    case 'g':
+    {
+      int w, h;
+      if (sscanf (optarg, "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+      {
+        omc->w = w;
+        omc->h = h;
+      }
+      break;
+    }
+    case 'j':
+      omc->threads = atoi (optarg);
+      if (omc->threads < 1)
+        omc->threads = 1;
+      break;
+    case 'm':
+      widget_size = (size_t) MAX (atoi (optarg), 0) << 20;
+      break;
+    case 'p':
+      omc->pack = optarg;
+      break;
+    case 'r':
+      if (scale_filter_by_name (optarg, &omc->filter) < 0)
+        fprintf (stderr, "*** ERROR: unknown filter %s\n", optarg);
+      break;
+    case 'H':
+      omc->headless = 1;
+      break;
+    case 'n':
+      omc->max_frames = strtoul (optarg, NULL, 10);
+      break;
+    case 'o':
+      omc->dump = optarg;
+      break;
+    case 'x':
+      omc->dump_hash = 1;
+      break;
+    case 's':
+      stats = 1;
+      stats_output = optarg;
+      break;
+    case 'S':
+      stats = 1;
+      overlay = 1;
+      break;
+    default:
+      usage (argv[0]);
+      free (omc);
+      return (c == 'h') ? 0 : 1;
+    }
+  }
+
+  if (stats)
+    stats_init (stats_output, overlay);
+
+  /* SDL dummy driver renders into a memory surface */
+  if (omc->headless)
+    SDL_putenv ("SDL_VIDEODRIVER=dummy");
+
+  /* before any thread gets created, so that all inherit the mask */
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGUSR1);
+  sigaddset (&signals, SIGUSR2);
+  pthread_sigmask (SIG_BLOCK, &signals, NULL);
   
   if (SDL_Init (SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0)
   {
@@ -77,6 +250,7 @@ main (int argc, char **argv)
 
   if (!TTF_WasInit ())
     TTF_Init ();
+  font_init ();
   
   SDL_VideoDriverName (vo_driver, 128);
   printf ("Using Video Driver: %s\n", vo_driver);
@@ -111,9 +285,9 @@ main (int argc, char **argv)
       printf ("  %d x %d\n", modes[i]->w, modes[i]->h);
   }
 
-  printf ("Checking mode %dx%d@%d\n",
-          omc->w, omc->h, DEFAULT_DEPTH);
-  bpp = SDL_VideoModeOK (omc->w, omc->h, DEFAULT_DEPTH, flags);
+  depth = omc->headless ? HEADLESS_DEPTH : DEFAULT_DEPTH;
+  printf ("Checking mode %dx%d@%d\n", omc->w, omc->h, depth);
+  bpp = SDL_VideoModeOK (omc->w, omc->h, depth, flags);
 
   if (!bpp)
   {
@@ -127,8 +301,24 @@ main (int argc, char **argv)
   if (vi->wm_available)
     SDL_WM_SetCaption (DEFAULT_WM_CAPTION, NULL);
 
+  /* the display thread composites with that many helpers */
+  pool_init (omc->threads - 1);
+  blit_init (BLIT_IMPL_AUTO);
+  scale_init (BLIT_IMPL_AUTO);
+  printf ("Alpha blending with %s kernels\n", blit_impl_name ());
+  printf ("Image scaling with %s kernels\n", scale_impl_name ());
+
+  /* images are decoded in background, but synchronously when headless
+   * so that a given frame always has the same content */
+  cache_init (cache_size);
+  if (omc->pack)
+    pack_open (omc->pack);
+  loader_init (omc->headless ? 0 : omc->threads);
+  widget_budget_init (widget_size);
+
   /* background thread that handles display and rendering */
   create_display_thread ();
+  omc->sth = SDL_CreateThread (signal_handler, NULL);
 
   /* init main screen */
   screen_init (SCREEN_TYPE_MAIN);
@@ -138,6 +328,20 @@ main (int argc, char **argv)
 
   while (SDL_WaitEvent (&event) != 0)
   {
+    /* decoded images are handed to their widgets from here */
+    if (event.type == SDL_USEREVENT && event.user.code == LOADER_EVENT)
+    {
+      loader_dispatch ();
+      continue;
+    }
+
+    /* and the stats overlay text refreshed */
+    if (event.type == SDL_USEREVENT && event.user.code == STATS_EVENT)
+    {
+      stats_overlay_update ();
+      continue;
+    }
+
     if (omc->scr && omc->scr->handle_event)
       omc->scr->handle_event (omc->scr, &event);
     else
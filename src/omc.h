@@ -26,13 +26,26 @@
 #include <SDL_thread.h>
 
 #include "screens/screen.h"
+#include "scale.h"
 
 typedef struct omc_s {
   SDL_Surface *display;     /* where widgets are displayed */
   screen_t *scr;            /* current screen */
   SDL_Thread *dth;          /* display/rendering thread */
+  SDL_Thread *sth;          /* signals handling thread */
   uint16_t w;
   uint16_t h;
+  int max_fps;              /* frame rate cap, 0 for none */
+  int threads;              /* compositing threads */
+  scale_filter_t filter;    /* images resampling */
+  char *pack;               /* baked images, rewritten when outdated */
+
+  /* offscreen rendering and frame dumping */
+  int headless;             /* render with no real display */
+  unsigned int max_frames;  /* quit after that many frames, 0 for never */
+  unsigned int frames;      /* frames rendered so far */
+  char *dump;               /* where dumped frames are saved */
+  int dump_hash;            /* print hash of dumped frames */
 } omc_t;
 
 omc_t *omc;
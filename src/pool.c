@@ -0,0 +1,174 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "pool.h"
+
+/* fork-join pool: pool_run() spreads job indices over the workers and
+ * the calling thread, and returns once they have all been processed */
+
+static SDL_Thread **threads;
+static int nb_threads;
+
+static SDL_mutex *lock;
+static SDL_cond *work_cond;  /* new job available, or quitting */
+static SDL_cond *done_cond;  /* all job indices processed */
+
+static pool_job_t job;
+static void *job_data;
+static int job_nb;
+static int job_next;
+static int job_done;
+static int busy;
+static int quit;
+
+static int
+pool_worker (void *data)
+{
+  SDL_mutexP (lock);
+  while (1)
+  {
+    int i;
+
+    while (!quit && job_next >= job_nb)
+      SDL_CondWait (work_cond, lock);
+    if (quit)
+      break;
+
+    i = job_next++;
+    SDL_mutexV (lock);
+
+    job (job_data, i);
+
+    SDL_mutexP (lock);
+    if (++job_done == job_nb)
+      SDL_CondSignal (done_cond);
+  }
+  SDL_mutexV (lock);
+
+  return 0;
+}
+
+void
+pool_init (int nb)
+{
+  int i;
+
+  if (threads || nb <= 0)
+    return;
+
+  lock = SDL_CreateMutex ();
+  work_cond = SDL_CreateCond ();
+  done_cond = SDL_CreateCond ();
+  job_nb = job_next = job_done = 0;
+  busy = quit = 0;
+
+  threads = malloc (nb * sizeof (SDL_Thread *));
+  for (i = 0; i < nb; i++)
+  {
+    threads[i] = SDL_CreateThread (pool_worker, NULL);
+    if (!threads[i])
+      break;
+  }
+  nb_threads = i;
+}
+
+void
+pool_uninit (void)
+{
+  int i;
+
+  if (!threads)
+    return;
+
+  SDL_mutexP (lock);
+  quit = 1;
+  SDL_CondBroadcast (work_cond);
+  SDL_mutexV (lock);
+
+  for (i = 0; i < nb_threads; i++)
+    SDL_WaitThread (threads[i], NULL);
+
+  free (threads);
+  threads = NULL;
+  nb_threads = 0;
+
+  SDL_DestroyCond (work_cond);
+  SDL_DestroyCond (done_cond);
+  SDL_DestroyMutex (lock);
+}
+
+int
+pool_threads (void)
+{
+  return nb_threads;
+}
+
+/* Runs job (data, i) for i in [0, nb[ and waits for completion.
+ * Falls back to the calling thread alone when the pool is already
+ * busy with another caller. */
+void
+pool_run (pool_job_t fn, void *data, int nb)
+{
+  int i;
+
+  if (!fn || nb <= 0)
+    return;
+
+  if (nb_threads)
+  {
+    SDL_mutexP (lock);
+    if (busy)
+      SDL_mutexV (lock);
+    else
+    {
+      busy = 1;
+      job = fn;
+      job_data = data;
+      job_nb = nb;
+      job_next = 0;
+      job_done = 0;
+      SDL_CondBroadcast (work_cond);
+
+      /* lend a hand */
+      while (job_next < job_nb)
+      {
+        i = job_next++;
+        SDL_mutexV (lock);
+        fn (data, i);
+        SDL_mutexP (lock);
+        job_done++;
+      }
+
+      while (job_done < job_nb)
+        SDL_CondWait (done_cond, lock);
+
+      job_nb = job_next = job_done = 0;
+      busy = 0;
+      SDL_mutexV (lock);
+      return;
+    }
+  }
+
+  for (i = 0; i < nb; i++)
+    fn (data, i);
+}
@@ -0,0 +1,665 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+
+#include "config.h"
+#include "scale.h"
+#include "pool.h"
+
+#if defined (HAVE_SSE2) || defined (HAVE_AVX2)
+#include <immintrin.h>
+#endif
+
+/* Separable resampling: each output row is first filtered vertically
+ * from the source rows into a temporary row, which is then filtered
+ * horizontally. All four bytes of a pixel are handled alike, whatever
+ * the channel order. Weights are 2.14 fixed point and sum up to one
+ * exactly, so that flat areas (e.g. an opaque alpha channel) keep their
+ * value. All kernels compute the same integer sums and give identical
+ * results. Output rows are split across the pool threads. */
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE  (1 << WEIGHT_BITS)
+#define WEIGHT_HALF (1 << (WEIGHT_BITS - 1))
+
+#define SCALE_ROWS_PER_JOB 16
+
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+typedef struct coefs_s {
+  int taps;             /* per output pixel, even, zero weights padded */
+  int *start;           /* first source pixel for each output one */
+  Sint16 *weights;      /* taps weights for each output pixel */
+} coefs_t;
+
+typedef void (*vert_row_t) (Uint8 **rows, const Sint16 *w, int taps,
+                            Uint8 *dst, int len);
+typedef void (*horiz_row_t) (const Uint8 *src, const coefs_t *c,
+                             Uint8 *dst, int w);
+
+static inline Uint8
+clamp_byte (int v)
+{
+  v = (v + WEIGHT_HALF) >> WEIGHT_BITS;
+  return (v < 0) ? 0 : (v > 255) ? 255 : v;
+}
+
+static inline Sint32
+weight_pair (const Sint16 *w)
+{
+  return (Uint16) w[0] | ((Uint32) (Uint16) w[1] << 16);
+}
+
+static void
+vert_row_scalar (Uint8 **rows, const Sint16 *w, int taps, Uint8 *dst, int len)
+{
+  int i, k;
+
+  for (i = 0; i < len; i++)
+  {
+    int sum = 0;
+
+    for (k = 0; k < taps; k++)
+      sum += rows[k][i] * w[k];
+    dst[i] = clamp_byte (sum);
+  }
+}
+
+static void
+horiz_row_scalar (const Uint8 *src, const coefs_t *c, Uint8 *dst, int w)
+{
+  int x, k, ch;
+
+  for (x = 0; x < w; x++)
+  {
+    const Uint8 *s = src + c->start[x] * 4;
+    const Sint16 *wt = c->weights + x * c->taps;
+
+    for (ch = 0; ch < 4; ch++)
+    {
+      int sum = 0;
+
+      for (k = 0; k < c->taps; k++)
+        sum += s[k * 4 + ch] * wt[k];
+      dst[x * 4 + ch] = clamp_byte (sum);
+    }
+  }
+}
+
+#ifdef HAVE_SSE2
+/* two taps at once: bytes of both rows are interleaved so that
+ * pmaddwd computes a * wa + b * wb */
+__attribute__ ((target ("sse2"))) static void
+vert_row_sse2 (Uint8 **rows, const Sint16 *w, int taps, Uint8 *dst, int len)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i half = _mm_set1_epi32 (WEIGHT_HALF);
+  int i, k;
+
+  for (i = 0; i + 16 <= len; i += 16)
+  {
+    __m128i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+    __m128i r0, r1;
+
+    for (k = 0; k < taps; k += 2)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (rows[k] + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (rows[k + 1] + i));
+      __m128i wp = _mm_set1_epi32 (weight_pair (w + k));
+      __m128i lo = _mm_unpacklo_epi8 (a, b);
+      __m128i hi = _mm_unpackhi_epi8 (a, b);
+
+      acc0 = _mm_add_epi32 (acc0,
+                            _mm_madd_epi16 (_mm_unpacklo_epi8 (lo, zero), wp));
+      acc1 = _mm_add_epi32 (acc1,
+                            _mm_madd_epi16 (_mm_unpackhi_epi8 (lo, zero), wp));
+      acc2 = _mm_add_epi32 (acc2,
+                            _mm_madd_epi16 (_mm_unpacklo_epi8 (hi, zero), wp));
+      acc3 = _mm_add_epi32 (acc3,
+                            _mm_madd_epi16 (_mm_unpackhi_epi8 (hi, zero), wp));
+    }
+
+    acc0 = _mm_srai_epi32 (_mm_add_epi32 (acc0, half), WEIGHT_BITS);
+    acc1 = _mm_srai_epi32 (_mm_add_epi32 (acc1, half), WEIGHT_BITS);
+    acc2 = _mm_srai_epi32 (_mm_add_epi32 (acc2, half), WEIGHT_BITS);
+    acc3 = _mm_srai_epi32 (_mm_add_epi32 (acc3, half), WEIGHT_BITS);
+    r0 = _mm_packs_epi32 (acc0, acc1);
+    r1 = _mm_packs_epi32 (acc2, acc3);
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (r0, r1));
+  }
+
+  if (i < len)
+  {
+    Uint8 *tail[taps];
+
+    for (k = 0; k < taps; k++)
+      tail[k] = rows[k] + i;
+    vert_row_scalar (tail, w, taps, dst + i, len - i);
+  }
+}
+
+/* two neighbour pixels at once, their channels interleaved */
+__attribute__ ((target ("sse2"))) static void
+horiz_row_sse2 (const Uint8 *src, const coefs_t *c, Uint8 *dst, int w)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i half = _mm_set1_epi32 (WEIGHT_HALF);
+  int x, k;
+
+  for (x = 0; x < w; x++)
+  {
+    const Uint8 *s = src + c->start[x] * 4;
+    const Sint16 *wt = c->weights + x * c->taps;
+    __m128i acc = zero;
+
+    for (k = 0; k < c->taps; k += 2)
+    {
+      __m128i p = _mm_loadl_epi64 ((const __m128i *) (s + k * 4));
+
+      p = _mm_unpacklo_epi8 (p, _mm_srli_si128 (p, 4));
+      p = _mm_unpacklo_epi8 (p, zero);
+      acc = _mm_add_epi32 (acc, _mm_madd_epi16 (p,
+                             _mm_set1_epi32 (weight_pair (wt + k))));
+    }
+
+    acc = _mm_srai_epi32 (_mm_add_epi32 (acc, half), WEIGHT_BITS);
+    acc = _mm_packs_epi32 (acc, acc);
+    acc = _mm_packus_epi16 (acc, acc);
+    *(Uint32 *) (dst + x * 4) = _mm_cvtsi128_si32 (acc);
+  }
+}
+#endif /* HAVE_SSE2 */
+
+#ifdef HAVE_AVX2
+/* same as SSE2, unpack and pack work per 128 bits lane and keep the
+ * bytes order */
+__attribute__ ((target ("avx2"))) static void
+vert_row_avx2 (Uint8 **rows, const Sint16 *w, int taps, Uint8 *dst, int len)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i half = _mm256_set1_epi32 (WEIGHT_HALF);
+  int i, k;
+
+  for (i = 0; i + 32 <= len; i += 32)
+  {
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+    __m256i r0, r1;
+
+    for (k = 0; k < taps; k += 2)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *) (rows[k] + i));
+      __m256i b = _mm256_loadu_si256 ((const __m256i *) (rows[k + 1] + i));
+      __m256i wp = _mm256_set1_epi32 (weight_pair (w + k));
+      __m256i lo = _mm256_unpacklo_epi8 (a, b);
+      __m256i hi = _mm256_unpackhi_epi8 (a, b);
+
+      acc0 = _mm256_add_epi32 (acc0, _mm256_madd_epi16
+                               (_mm256_unpacklo_epi8 (lo, zero), wp));
+      acc1 = _mm256_add_epi32 (acc1, _mm256_madd_epi16
+                               (_mm256_unpackhi_epi8 (lo, zero), wp));
+      acc2 = _mm256_add_epi32 (acc2, _mm256_madd_epi16
+                               (_mm256_unpacklo_epi8 (hi, zero), wp));
+      acc3 = _mm256_add_epi32 (acc3, _mm256_madd_epi16
+                               (_mm256_unpackhi_epi8 (hi, zero), wp));
+    }
+
+    acc0 = _mm256_srai_epi32 (_mm256_add_epi32 (acc0, half), WEIGHT_BITS);
+    acc1 = _mm256_srai_epi32 (_mm256_add_epi32 (acc1, half), WEIGHT_BITS);
+    acc2 = _mm256_srai_epi32 (_mm256_add_epi32 (acc2, half), WEIGHT_BITS);
+    acc3 = _mm256_srai_epi32 (_mm256_add_epi32 (acc3, half), WEIGHT_BITS);
+    r0 = _mm256_packs_epi32 (acc0, acc1);
+    r1 = _mm256_packs_epi32 (acc2, acc3);
+    _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_packus_epi16 (r0, r1));
+  }
+
+  if (i < len)
+  {
+    Uint8 *tail[taps];
+
+    for (k = 0; k < taps; k++)
+      tail[k] = rows[k] + i;
+    vert_row_scalar (tail, w, taps, dst + i, len - i);
+  }
+}
+#endif /* HAVE_AVX2 */
+
+static vert_row_t vert_row = vert_row_scalar;
+static horiz_row_t horiz_row = horiz_row_scalar;
+static blit_impl_t scale_impl = BLIT_IMPL_SCALAR;
+
+static const char *impl_names[] = {
+  [BLIT_IMPL_AUTO]   = "auto",
+  [BLIT_IMPL_SCALAR] = "scalar",
+  [BLIT_IMPL_SSE2]   = "sse2",
+  [BLIT_IMPL_AVX2]   = "avx2",
+};
+
+static int
+scale_lookup (blit_impl_t impl, vert_row_t *v, horiz_row_t *h)
+{
+  switch (impl)
+  {
+  case BLIT_IMPL_SCALAR:
+    *v = vert_row_scalar;
+    *h = horiz_row_scalar;
+    return 0;
+#ifdef HAVE_SSE2
+  case BLIT_IMPL_SSE2:
+    if (!__builtin_cpu_supports ("sse2"))
+      return -1;
+    *v = vert_row_sse2;
+    *h = horiz_row_sse2;
+    return 0;
+#endif
+#if defined (HAVE_AVX2) && defined (HAVE_SSE2)
+  case BLIT_IMPL_AVX2:
+    if (!__builtin_cpu_supports ("avx2"))
+      return -1;
+    /* horizontal pass has 4 bytes per pixel to work on, SSE2 fits */
+    *v = vert_row_avx2;
+    *h = horiz_row_sse2;
+    return 0;
+#endif
+  default:
+    return -1;
+  }
+}
+
+/* must be called before any other thread may scale */
+int
+scale_init (blit_impl_t impl)
+{
+  vert_row_t v;
+  horiz_row_t h;
+
+  if (impl == BLIT_IMPL_AUTO)
+  {
+    for (impl = BLIT_IMPL_AVX2; impl > BLIT_IMPL_SCALAR; impl--)
+      if (!scale_lookup (impl, &v, &h))
+        break;
+  }
+
+  if (scale_lookup (impl, &v, &h) < 0)
+    return -1;
+
+  vert_row = v;
+  horiz_row = h;
+  scale_impl = impl;
+
+  return 0;
+}
+
+const char *
+scale_impl_name (void)
+{
+  return impl_names[scale_impl];
+}
+
+/* whether SIMD kernels are in use, the scalar ones are slower than
+ * SDL_gfx zoomSurface() */
+int
+scale_accelerated (void)
+{
+  return scale_impl != BLIT_IMPL_SCALAR;
+}
+
+static const struct {
+  const char *name;
+  scale_filter_t filter;
+  double support;       /* radius, in source pixels when magnifying */
+} filters[] = {
+  { "box",      SCALE_BOX,      0.5 },
+  { "bilinear", SCALE_BILINEAR, 1.0 },
+  { "lanczos3", SCALE_LANCZOS3, 3.0 },
+  { "fast",     SCALE_FAST,     1.0 },
+};
+
+int
+scale_filter_by_name (const char *name, scale_filter_t *filter)
+{
+  int i;
+
+  for (i = 0; i < sizeof (filters) / sizeof (filters[0]); i++)
+    if (!strcmp (name, filters[i].name))
+    {
+      *filter = filters[i].filter;
+      return 0;
+    }
+
+  return -1;
+}
+
+static double
+sinc (double x)
+{
+  if (x == 0.0)
+    return 1.0;
+  x *= M_PI;
+  return sin (x) / x;
+}
+
+static double
+filter_weight (scale_filter_t filter, double t)
+{
+  switch (filter)
+  {
+  case SCALE_BOX:
+    return (t >= -0.5 && t < 0.5) ? 1.0 : 0.0;
+  case SCALE_BILINEAR:
+  case SCALE_FAST:
+    t = fabs (t);
+    return (t < 1.0) ? 1.0 - t : 0.0;
+  case SCALE_LANCZOS3:
+    return (fabs (t) < 3.0) ? sinc (t) * sinc (t / 3.0) : 0.0;
+  }
+
+  return 0.0;
+}
+
+static void
+coefs_free (coefs_t *c)
+{
+  free (c->start);
+  free (c->weights);
+}
+
+/* weights to resample src_len pixels into dst_len ones */
+static int
+coefs_compute (coefs_t *c, scale_filter_t filter, int src_len, int dst_len)
+{
+  double scale = (double) dst_len / src_len;
+  double fscale = (scale < 1.0) ? 1.0 / scale : 1.0;
+  double support = filters[filter].support * fscale;
+  double *fw;
+  int x, k;
+
+  /* enough for any window, rounded up to pairs of taps; the fast
+   * filter only ever blends the two source pixels around the center */
+  if (filter == SCALE_FAST)
+    c->taps = 2;
+  else
+    c->taps = ((int) ceil (support * 2) + 2 + 1) & ~1;
+  c->start = malloc (dst_len * sizeof (int));
+  c->weights = calloc (dst_len * c->taps, sizeof (Sint16));
+  fw = malloc (c->taps * sizeof (double));
+  if (!c->start || !c->weights || !fw)
+  {
+    coefs_free (c);
+    free (fw);
+    return -1;
+  }
+
+  for (x = 0; x < dst_len; x++)
+  {
+    double center = (x + 0.5) / scale;
+    double sum = 0.0;
+    int lo, hi, isum = 0, best = 0;
+    Sint16 *w = c->weights + x * c->taps;
+
+    if (filter == SCALE_FAST)
+    {
+      double pos = center - 0.5;
+      int frac;
+
+      /* past the first or last center, the edge pixel alone */
+      lo = (int) floor (pos);
+      frac = (int) lrint ((pos - lo) * WEIGHT_ONE);
+      if (lo < 0)
+        lo = frac = 0;
+      else if (lo >= src_len - 1)
+      {
+        lo = src_len - 1;
+        frac = 0;
+      }
+
+      c->start[x] = lo;
+      w[0] = WEIGHT_ONE - frac;
+      w[1] = frac;
+      continue;
+    }
+
+    lo = MAX ((int) floor (center - support), 0);
+    hi = MIN ((int) ceil (center + support), src_len);
+    if (hi - lo > c->taps)
+      hi = lo + c->taps;
+
+    for (k = 0; k < hi - lo; k++)
+    {
+      fw[k] = filter_weight (filter, (lo + k + 0.5 - center) / fscale);
+      sum += fw[k];
+    }
+
+    c->start[x] = lo;
+    if (sum == 0.0)
+    {
+      /* nearest source pixel */
+      c->start[x] = MIN ((int) center, src_len - 1);
+      w[0] = WEIGHT_ONE;
+      continue;
+    }
+
+    for (k = 0; k < hi - lo; k++)
+    {
+      w[k] = (Sint16) lrint (fw[k] / sum * WEIGHT_ONE);
+      isum += w[k];
+      if (w[k] > w[best])
+        best = k;
+    }
+
+    /* rounding errors go to the main tap, so that weights add up to one */
+    w[best] += WEIGHT_ONE - isum;
+  }
+
+  free (fw);
+  return 0;
+}
+
+typedef struct scale_job_s {
+  SDL_Surface *src;
+  SDL_Surface *dst;
+  coefs_t h;
+  coefs_t v;
+} scale_job_t;
+
+static void
+scale_rows (void *data, int index)
+{
+  scale_job_t *job = (scale_job_t *) data;
+  SDL_Surface *src = job->src, *dst = job->dst;
+  int taps = job->v.taps;
+  int y, y_end, k;
+  Uint8 *tmp, *rows[taps];
+
+  /* room for the padded taps past the last pixel, never weighted */
+  tmp = calloc (src->w + job->h.taps, 4);
+  if (!tmp)
+    return;
+
+  y = index * SCALE_ROWS_PER_JOB;
+  y_end = MIN (y + SCALE_ROWS_PER_JOB, dst->h);
+  for (; y < y_end; y++)
+  {
+    for (k = 0; k < taps; k++)
+    {
+      int sy = MIN (job->v.start[y] + k, src->h - 1);
+      rows[k] = (Uint8 *) src->pixels + sy * src->pitch;
+    }
+
+    vert_row (rows, job->v.weights + y * taps, taps, tmp, src->w * 4);
+    horiz_row (tmp, &job->h, (Uint8 *) dst->pixels + y * dst->pitch, dst->w);
+  }
+
+  free (tmp);
+}
+
+SDL_Surface *
+scale_surface (SDL_Surface *src, int w, int h, scale_filter_t filter)
+{
+  SDL_PixelFormat *fmt;
+  SDL_Surface *dst;
+  scale_job_t job;
+
+  if (!src || w <= 0 || h <= 0 || src->format->BytesPerPixel != 4)
+    return NULL;
+
+  fmt = src->format;
+  dst = SDL_CreateRGBSurface (src->flags & SDL_SRCALPHA,
+                              w, h, 32, fmt->Rmask, fmt->Gmask,
+                              fmt->Bmask, fmt->Amask);
+  if (!dst)
+    return NULL;
+
+  if (coefs_compute (&job.h, filter, src->w, w) < 0)
+  {
+    SDL_FreeSurface (dst);
+    return NULL;
+  }
+  if (coefs_compute (&job.v, filter, src->h, h) < 0)
+  {
+    coefs_free (&job.h);
+    SDL_FreeSurface (dst);
+    return NULL;
+  }
+
+  if (SDL_MUSTLOCK (src))
+    SDL_LockSurface (src);
+
+  job.src = src;
+  job.dst = dst;
+  pool_run (scale_rows, &job,
+            (h + SCALE_ROWS_PER_JOB - 1) / SCALE_ROWS_PER_JOB);
+
+  if (SDL_MUSTLOCK (src))
+    SDL_UnlockSurface (src);
+
+  coefs_free (&job.h);
+  coefs_free (&job.v);
+
+  return dst;
+}
+
+/* Streamed resampling, for sources decoded one row at a time: only the
+ * last source rows the vertical filter needs are kept around. Output
+ * is the same as scale_surface() gives. */
+struct scale_stream_s {
+  SDL_Surface *dst;
+  int src_w, src_h;
+  coefs_t h;
+  coefs_t v;
+  Uint8 *ring;          /* last v.taps source rows */
+  Uint8 *tmp;
+  int next;             /* next source row to be pushed */
+  int y;                /* next output row */
+};
+
+scale_stream_t *
+scale_stream_new (int src_w, int src_h, SDL_Surface *dst,
+                  scale_filter_t filter)
+{
+  scale_stream_t *s;
+
+  if (src_w <= 0 || src_h <= 0 || !dst || dst->format->BytesPerPixel != 4)
+    return NULL;
+
+  s = calloc (1, sizeof (scale_stream_t));
+  if (!s)
+    return NULL;
+
+  s->dst = dst;
+  s->src_w = src_w;
+  s->src_h = src_h;
+
+  if (coefs_compute (&s->h, filter, src_w, dst->w) < 0)
+  {
+    free (s);
+    return NULL;
+  }
+  if (coefs_compute (&s->v, filter, src_h, dst->h) < 0)
+  {
+    coefs_free (&s->h);
+    free (s);
+    return NULL;
+  }
+
+  s->ring = malloc (s->v.taps * src_w * 4);
+  s->tmp = calloc (src_w + s->h.taps, 4);
+  if (!s->ring || !s->tmp)
+  {
+    scale_stream_free (s);
+    return NULL;
+  }
+
+  return s;
+}
+
+void
+scale_stream_free (scale_stream_t *s)
+{
+  if (!s)
+    return;
+
+  coefs_free (&s->h);
+  coefs_free (&s->v);
+  free (s->ring);
+  free (s->tmp);
+  free (s);
+}
+
+/* where the caller writes the next source row, 32 bits pixels */
+Uint8 *
+scale_stream_row (scale_stream_t *s)
+{
+  return s->ring + (s->next % s->v.taps) * s->src_w * 4;
+}
+
+/* the row is written, outputs every row that depends on it last */
+void
+scale_stream_push (scale_stream_t *s)
+{
+  SDL_Surface *dst = s->dst;
+  int taps = s->v.taps;
+  Uint8 *rows[taps];
+  int k;
+
+  s->next++;
+
+  while (s->y < dst->h
+         && MIN (s->v.start[s->y] + taps, s->src_h) <= s->next)
+  {
+    for (k = 0; k < taps; k++)
+    {
+      int sy = MIN (s->v.start[s->y] + k, s->src_h - 1);
+      rows[k] = s->ring + (sy % taps) * s->src_w * 4;
+    }
+
+    vert_row (rows, s->v.weights + s->y * taps, taps, s->tmp, s->src_w * 4);
+    horiz_row (s->tmp, &s->h,
+               (Uint8 *) dst->pixels + s->y * dst->pitch, dst->w);
+    s->y++;
+  }
+}
@@ -0,0 +1,53 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _SCALE_H_
+#define _SCALE_H_
+
+#include <SDL.h>
+
+#include "blit.h"
+
+typedef enum {
+  SCALE_BOX,
+  SCALE_BILINEAR,
+  SCALE_LANCZOS3,
+  SCALE_FAST,           /* bilinear, never widened when shrinking */
+} scale_filter_t;
+
+int scale_init (blit_impl_t impl);
+const char *scale_impl_name (void);
+int scale_accelerated (void);
+int scale_filter_by_name (const char *name, scale_filter_t *filter);
+
+/* resamples a 32 bits surface to w x h, in the same pixel format;
+ * returns NULL for other depths */
+SDL_Surface *scale_surface (SDL_Surface *src, int w, int h,
+                            scale_filter_t filter);
+
+typedef struct scale_stream_s scale_stream_t;
+
+/* same, with source rows given one at a time into a 32 bits dst */
+scale_stream_t *scale_stream_new (int src_w, int src_h, SDL_Surface *dst,
+                                  scale_filter_t filter);
+void scale_stream_free (scale_stream_t *s);
+Uint8 *scale_stream_row (scale_stream_t *s);
+void scale_stream_push (scale_stream_t *s);
+
+#endif /* _SCALE_H_ */
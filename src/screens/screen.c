@@ -23,6 +23,7 @@
 #include "omc.h"
 #include "screen.h"
 #include "widgets/widget.h"
+#include "stats.h"
 
 static int
 get_list_length (void *list)
@@ -36,21 +37,82 @@ get_list_length (void *list)
   return n;
 }
 
+static void
+layer_add_widget (layer_t *layer, widget_t *widget)
+{
+  if (layer->nb == layer->size)
+  {
+    layer->size = layer->size ? 2 * layer->size : 8;
+    layer->widgets =
+      realloc (layer->widgets, layer->size * sizeof (*(layer->widgets)));
+    layer->dirty =
+      realloc (layer->dirty, layer->size * sizeof (*(layer->dirty)));
+  }
+
+  widget->stack = layer->nb;
+  layer->widgets[layer->nb++] = widget;
+}
+
+static void
+layer_remove_widget (layer_t *layer, widget_t *widget)
+{
+  int i;
+
+  if (widget->stack >= layer->nb || layer->widgets[widget->stack] != widget)
+    return;
+
+  /* keep drawing order of remaining widgets */
+  layer->nb--;
+  for (i = widget->stack; i < layer->nb; i++)
+  {
+    layer->widgets[i] = layer->widgets[i + 1];
+    layer->widgets[i]->stack = i;
+  }
+
+  if (!widget->dirty)
+    return;
+
+  for (i = 0; i < layer->nb_dirty; i++)
+    if (layer->dirty[i] == widget)
+    {
+      layer->dirty[i] = layer->dirty[--layer->nb_dirty];
+      break;
+    }
+}
+
+static void
+layer_free (layer_t *layer)
+{
+  if (layer->widgets)
+    free (layer->widgets);
+  if (layer->dirty)
+    free (layer->dirty);
+}
+
 void
 screen_uninit (screen_t *screen)
 {
   widget_t **widgets;
+  int i;
   
   if (!screen)
     return;
 
   if (screen->uninit)
     screen->uninit (screen);
+  stats_overlay_detach (screen);
 
   /* free widgets */
   for (widgets = screen->wlist; *widgets; widgets++)
     widget_free (*widgets);
   free (screen->wlist);
+
+  for (i = 0; i < MAX_DEPTH; i++)
+    layer_free (&screen->layers[i]);
+  spatial_free (screen->index);
+  if (screen->hits)
+    free (screen->hits);
+  SDL_DestroyMutex (screen->lock);
   
   free (screen);
 }
@@ -64,6 +126,12 @@ screen_init (screen_type_t type)
   screen = malloc (sizeof (screen_t));
   screen->wlist = malloc (sizeof (widget_t *));
   *(screen->wlist) = NULL;
+  memset (screen->layers, 0, sizeof (screen->layers));
+  screen->nb_dirty = 0;
+  screen->index = spatial_new (omc->w, omc->h);
+  screen->hits = NULL;
+  screen->hits_size = 0;
+  screen->lock = SDL_CreateMutex ();
   screen->type = type;
   screen->current = NULL;
   screen->priv = NULL;
@@ -77,8 +145,11 @@ screen_init (screen_type_t type)
     break;
   }
 
+  stats_overlay_attach (screen);
+
   /* new current screen */
   omc->scr = screen;
+  display_wakeup ();
 }
 
 void
@@ -109,6 +180,18 @@ screen_add_widget (screen_t *screen, widget_t *widget)
   screen->wlist[n] = NULL;
   screen->wlist[n - 1] = widget;
 
+  if (widget->layer >= MAX_DEPTH)
+    widget->layer = MAX_DEPTH - 1;
+
+  SDL_mutexP (screen->lock);
+  layer_add_widget (&screen->layers[widget->layer], widget);
+  spatial_insert (screen->index, widget);
+  widget->screen = screen;
+  SDL_mutexV (screen->lock);
+
+  if (widget_get_flag (widget, WIDGET_FLAG_NEED_REDRAW))
+    screen_mark_dirty (screen, widget);
+
   if (!screen->current && widget_get_flag (widget, WIDGET_FLAG_FOCUSABLE))
   {
     /* set focus to first focusable widget */
@@ -117,3 +200,272 @@ screen_add_widget (screen_t *screen, widget_t *widget)
   }
   
 }
+
+void
+screen_remove_widget (screen_t *screen, widget_t *widget)
+{
+  widget_t **widgets;
+
+  if (!screen || !widget || widget->screen != screen)
+    return;
+
+  SDL_mutexP (screen->lock);
+  for (widgets = screen->wlist; *widgets; widgets++)
+    if (*widgets == widget)
+    {
+      do
+        *widgets = *(widgets + 1);
+      while (*(widgets++));
+      break;
+    }
+
+  layer_remove_widget (&screen->layers[widget->layer], widget);
+  if (widget->dirty)
+    screen->nb_dirty--;
+  widget->dirty = 0;
+  spatial_remove (screen->index, widget);
+  widget->screen = NULL;
+  SDL_mutexV (screen->lock);
+
+  if (screen->current == widget)
+    screen->current = NULL;
+
+  /* uncover what was underneath */
+  screen_invalidate_area (screen, widget_get_rect (widget), widget->layer);
+}
+
+void
+screen_move_widget (screen_t *screen, widget_t *widget, SDL_Rect *r)
+{
+  SDL_Rect old;
+
+  if (!screen || !widget || !r || widget->screen != screen)
+    return;
+
+  old = widget_get_rect (widget);
+
+  SDL_mutexP (screen->lock);
+  spatial_remove (screen->index, widget);
+  widget->x = r->x;
+  widget->y = r->y;
+  widget->w = r->w;
+  widget->h = r->h;
+  spatial_insert (screen->index, widget);
+  SDL_mutexV (screen->lock);
+
+  /* lower layers have to repaint the area the widget just left */
+  screen_invalidate_area (screen, old, widget->layer);
+}
+
+/* Lower layers than layer have to redraw their part of area. */
+void
+screen_invalidate_area (screen_t *screen, SDL_Rect area, int layer)
+{
+  int i, n;
+
+  if (!screen || !area.w || !area.h)
+    return;
+
+  SDL_mutexP (screen->lock);
+  n = spatial_query (screen->index, &area, 0, layer,
+                     &screen->hits, &screen->hits_size);
+  for (i = 0; i < n; i++)
+    widget_set_redraw_area (screen->hits[i], area);
+  SDL_mutexV (screen->lock);
+}
+
+/* What is stacked above widget, later in its layer or in upper layers,
+ * has to redraw its part of area, as it gets drawn over. */
+void
+screen_invalidate_above (screen_t *screen, widget_t *widget, SDL_Rect area)
+{
+  int i, n;
+
+  if (!screen || !widget || widget->screen != screen || !area.w || !area.h)
+    return;
+
+  SDL_mutexP (screen->lock);
+  n = spatial_query (screen->index, &area, widget->layer, MAX_DEPTH,
+                     &screen->hits, &screen->hits_size);
+  for (i = 0; i < n; i++)
+  {
+    widget_t *w = screen->hits[i];
+
+    if (w->layer > widget->layer || w->stack > widget->stack)
+      widget_set_redraw_area (w, area);
+  }
+  SDL_mutexV (screen->lock);
+}
+
+/* Splits area into the parts of widget that are not hidden by opaque
+ * widgets from upper layers. Gives up splitting, and keeps drawing too
+ * much, when more than SCREEN_MAX_PARTS parts would be needed.
+ * Returns the number of parts, 0 when widget is fully covered. */
+int
+screen_visible_parts (screen_t *screen, widget_t *widget,
+                      SDL_Rect *area, SDL_Rect *parts)
+{
+  SDL_Rect tmp[SCREEN_MAX_PARTS];
+  int i, j, n, nb = 1;
+
+  if (!screen || !widget || !area || !parts || !area->w || !area->h)
+    return 0;
+
+  parts[0] = *area;
+
+  SDL_mutexP (screen->lock);
+  n = spatial_query (screen->index, area, widget->layer + 1, MAX_DEPTH,
+                     &screen->hits, &screen->hits_size);
+
+  for (i = 0; i < n && nb; i++)
+  {
+    widget_t *w = screen->hits[i];
+    SDL_Rect cover;
+    int nb_tmp = 0;
+
+    if (!widget_get_flag (w, WIDGET_FLAG_OPAQUE)
+        || !widget_get_flag (w, WIDGET_FLAG_SHOW))
+      continue;
+
+    /* only what remains visible through its parent hides anything */
+    cover = widget_get_rect (w);
+    if (w->parent)
+    {
+      SDL_Rect r = widget_get_rect (w->parent);
+      if (!rect_intersect (&cover, &r, &cover))
+        continue;
+    }
+
+    for (j = 0; j < nb; j++)
+      nb_tmp += rect_subtract (&parts[j], &cover, NULL);
+    if (nb_tmp > SCREEN_MAX_PARTS)
+      continue;
+
+    for (j = 0, nb_tmp = 0; j < nb; j++)
+      nb_tmp += rect_subtract (&parts[j], &cover, &tmp[nb_tmp]);
+    memcpy (parts, tmp, nb_tmp * sizeof (SDL_Rect));
+    nb = nb_tmp;
+  }
+  SDL_mutexV (screen->lock);
+
+  return nb;
+}
+
+void
+screen_set_widget_layer (screen_t *screen, widget_t *widget, int layer)
+{
+  int dirty;
+
+  if (!screen || !widget || widget->screen != screen)
+    return;
+
+  if (layer < 0)
+    layer = 0;
+  if (layer >= MAX_DEPTH)
+    layer = MAX_DEPTH - 1;
+
+  SDL_mutexP (screen->lock);
+  dirty = widget->dirty;
+  layer_remove_widget (&screen->layers[widget->layer], widget);
+  widget->layer = layer;
+  layer_add_widget (&screen->layers[layer], widget);
+  if (dirty)
+  {
+    layer_t *l = &screen->layers[layer];
+    l->dirty[l->nb_dirty++] = widget;
+  }
+  SDL_mutexV (screen->lock);
+}
+
+void
+screen_mark_dirty (screen_t *screen, widget_t *widget)
+{
+  layer_t *layer;
+
+  if (!screen || !widget || widget->screen != screen)
+    return;
+
+  SDL_mutexP (screen->lock);
+  if (!widget->dirty)
+  {
+    layer = &screen->layers[widget->layer];
+    layer->dirty[layer->nb_dirty++] = widget;
+    widget->dirty = 1;
+    screen->nb_dirty++;
+
+    /* display thread sleeps until there is something to draw */
+    if (screen == omc->scr)
+      display_wakeup ();
+  }
+  SDL_mutexV (screen->lock);
+}
+
+static int
+stack_cmp (const void *a, const void *b)
+{
+  const widget_t *wa = *(widget_t * const *) a;
+  const widget_t *wb = *(widget_t * const *) b;
+
+  return wa->stack - wb->stack;
+}
+
+/* Moves all dirty widgets to list, from the farest layer to the closest
+ * one and in drawing order within a layer, and hands their pending area
+ * over to the display thread.
+ * list is grown as needed and belongs to the caller.
+ * Returns the number of widgets to be drawn. */
+int
+screen_collect_dirty (screen_t *screen, widget_t ***list, int *size)
+{
+  int i, j, n = 0;
+
+  if (!screen || !list || !size)
+    return 0;
+
+  SDL_mutexP (screen->lock);
+
+  /* idle frame */
+  if (!screen->nb_dirty)
+  {
+    SDL_mutexV (screen->lock);
+    return 0;
+  }
+
+  if (screen->nb_dirty > *size)
+  {
+    *size = screen->nb_dirty;
+    *list = realloc (*list, *size * sizeof (**list));
+  }
+
+  for (i = 0; i < MAX_DEPTH; i++)
+  {
+    layer_t *layer = &screen->layers[i];
+
+    /* overlapping widgets are drawn in the order they are stacked */
+    qsort (layer->dirty, layer->nb_dirty, sizeof (*(layer->dirty)),
+           stack_cmp);
+
+    for (j = 0; j < layer->nb_dirty; j++)
+    {
+      widget_t *widget = layer->dirty[j];
+
+      widget->dirty = 0;
+
+      /* full redraw, or only the parts uncovered by upper layers */
+      if (widget_get_flag (widget, WIDGET_FLAG_NEED_REDRAW))
+        widget->draw_area = widget_get_rect (widget);
+      else
+        widget->draw_area = widget->redraw_area;
+      widget->redraw_area.w = 0;
+      widget->redraw_area.h = 0;
+
+      widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 0);
+      (*list)[n++] = widget;
+    }
+    layer->nb_dirty = 0;
+  }
+  screen->nb_dirty = 0;
+  SDL_mutexV (screen->lock);
+
+  return n;
+}
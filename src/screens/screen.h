@@ -21,16 +21,36 @@
 #define _SCREEN_H_
 
 #include <SDL.h>
+#include <SDL_thread.h>
+
 #include "widgets/widget.h"
+#include "display.h"
+#include "spatial.h"
+
+#define SCREEN_MAX_PARTS 16 /* visible parts of a partly covered widget */
 
 typedef enum {
   SCREEN_TYPE_MAIN
 } screen_type_t;
 
+typedef struct layer_s {
+  widget_t **widgets;   /* widgets living on this layer, in drawing order */
+  int nb;
+  widget_t **dirty;     /* widgets from this layer that need a redraw */
+  int nb_dirty;
+  int size;             /* allocated slots, for both lists */
+} layer_t;
+
 typedef struct screen_s {
   screen_type_t type;
   widget_t *current; /* widget that has focus */
   widget_t **wlist;
+  layer_t layers[MAX_DEPTH];
+  int nb_dirty;      /* dirty widgets, all layers together */
+  spatial_t *index;  /* widgets geometry, for overlap lookups */
+  widget_t **hits;   /* spatial queries results */
+  int hits_size;
+  SDL_mutex *lock;   /* protects layers, dirty lists and index */
   void *priv;
   int (*handle_event) (struct screen_s *screen, SDL_Event *ev);
   void (*uninit) (struct screen_s *screen);
@@ -41,5 +61,15 @@ void screen_uninit (screen_t *screen);
 void screen_switch (screen_type_t type);
 
 void screen_add_widget (screen_t *screen, widget_t *widget);
+void screen_remove_widget (screen_t *screen, widget_t *widget);
+void screen_move_widget (screen_t *screen, widget_t *widget, SDL_Rect *r);
+void screen_invalidate_area (screen_t *screen, SDL_Rect area, int layer);
+void screen_invalidate_above (screen_t *screen, widget_t *widget,
+                              SDL_Rect area);
+int screen_visible_parts (screen_t *screen, widget_t *widget,
+                          SDL_Rect *area, SDL_Rect *parts);
+void screen_set_widget_layer (screen_t *screen, widget_t *widget, int layer);
+void screen_mark_dirty (screen_t *screen, widget_t *widget);
+int screen_collect_dirty (screen_t *screen, widget_t ***list, int *size);
 
 #endif /* _SCREEN_H_ */
@@ -135,6 +135,7 @@ screen_main_init (screen_t *screen)
                    "examples/FreeSans.ttf", 24,
                     0xFF, 0xFF, 0xFF, 0, 0, 0, 990, 85, 0, 0,
                     NULL, NULL, NULL, NULL);
+  text_set_tabular (clock, 1);
   clock_cb (10, clock);
   screen_add_widget (screen, clock);
 
@@ -0,0 +1,181 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spatial.h"
+#include "display.h"
+
+spatial_t *
+spatial_new (int w, int h)
+{
+  spatial_t *sp;
+
+  sp = malloc (sizeof (spatial_t));
+  sp->cols = ((w > 0 ? w : 1) + (1 << SPATIAL_CELL_SHIFT) - 1)
+    >> SPATIAL_CELL_SHIFT;
+  sp->rows = ((h > 0 ? h : 1) + (1 << SPATIAL_CELL_SHIFT) - 1)
+    >> SPATIAL_CELL_SHIFT;
+  sp->cells = calloc (sp->cols * sp->rows, sizeof (spatial_cell_t));
+  sp->stamp = 0;
+
+  return sp;
+}
+
+void
+spatial_free (spatial_t *sp)
+{
+  int i;
+
+  if (!sp)
+    return;
+
+  for (i = 0; i < sp->cols * sp->rows; i++)
+    if (sp->cells[i].widgets)
+      free (sp->cells[i].widgets);
+
+  free (sp->cells);
+  free (sp);
+}
+
+/* cells covered by r, clamped to the grid; returns 0 for empty areas */
+static int
+spatial_span (spatial_t *sp, SDL_Rect *r,
+              int *c0, int *r0, int *c1, int *r1)
+{
+  if (!r->w || !r->h)
+    return 0;
+
+  *c0 = MAX (r->x, 0) >> SPATIAL_CELL_SHIFT;
+  *r0 = MAX (r->y, 0) >> SPATIAL_CELL_SHIFT;
+  *c1 = MAX (r->x + r->w - 1, 0) >> SPATIAL_CELL_SHIFT;
+  *r1 = MAX (r->y + r->h - 1, 0) >> SPATIAL_CELL_SHIFT;
+
+  *c0 = MIN (*c0, sp->cols - 1);
+  *r0 = MIN (*r0, sp->rows - 1);
+  *c1 = MIN (*c1, sp->cols - 1);
+  *r1 = MIN (*r1, sp->rows - 1);
+
+  return 1;
+}
+
+void
+spatial_insert (spatial_t *sp, widget_t *widget)
+{
+  int c0, r0, c1, r1, i, j;
+
+  if (!sp || !widget)
+    return;
+
+  widget->indexed = widget_get_rect (widget);
+  if (!spatial_span (sp, &widget->indexed, &c0, &r0, &c1, &r1))
+    return;
+
+  for (j = r0; j <= r1; j++)
+    for (i = c0; i <= c1; i++)
+    {
+      spatial_cell_t *cell = &sp->cells[j * sp->cols + i];
+
+      if (cell->nb == cell->size)
+      {
+        cell->size = cell->size ? 2 * cell->size : 4;
+        cell->widgets =
+          realloc (cell->widgets, cell->size * sizeof (*(cell->widgets)));
+      }
+      cell->widgets[cell->nb++] = widget;
+    }
+}
+
+void
+spatial_remove (spatial_t *sp, widget_t *widget)
+{
+  int c0, r0, c1, r1, i, j, k;
+
+  if (!sp || !widget)
+    return;
+
+  /* widget is registered with the geometry it had when inserted */
+  if (!spatial_span (sp, &widget->indexed, &c0, &r0, &c1, &r1))
+    return;
+
+  for (j = r0; j <= r1; j++)
+    for (i = c0; i <= c1; i++)
+    {
+      spatial_cell_t *cell = &sp->cells[j * sp->cols + i];
+
+      for (k = 0; k < cell->nb; k++)
+        if (cell->widgets[k] == widget)
+        {
+          cell->widgets[k] = cell->widgets[--cell->nb];
+          break;
+        }
+    }
+
+  widget->indexed.w = 0;
+  widget->indexed.h = 0;
+}
+
+/* Stores in list all widgets from layers in [from, to[ intersecting area.
+ * list is grown as needed and belongs to the caller.
+ * Returns the number of widgets found. */
+int
+spatial_query (spatial_t *sp, SDL_Rect *area, int from, int to,
+               widget_t ***list, int *size)
+{
+  int c0, r0, c1, r1, i, j, k, n = 0;
+
+  if (!sp || !area || !list || !size)
+    return 0;
+
+  if (!spatial_span (sp, area, &c0, &r0, &c1, &r1))
+    return 0;
+
+  /* 0 is the stamp of widgets never queried */
+  if (++sp->stamp == 0)
+    sp->stamp = 1;
+
+  for (j = r0; j <= r1; j++)
+    for (i = c0; i <= c1; i++)
+    {
+      spatial_cell_t *cell = &sp->cells[j * sp->cols + i];
+
+      for (k = 0; k < cell->nb; k++)
+      {
+        widget_t *w = cell->widgets[k];
+        SDL_Rect r;
+
+        if (w->layer < from || w->layer >= to || w->stamp == sp->stamp)
+          continue;
+        w->stamp = sp->stamp;
+
+        if (!rect_intersect (area, &w->indexed, &r))
+          continue;
+
+        if (n == *size)
+        {
+          *size = *size ? 2 * *size : 16;
+          *list = realloc (*list, *size * sizeof (**list));
+        }
+        (*list)[n++] = w;
+      }
+    }
+
+  return n;
+}
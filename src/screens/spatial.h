@@ -0,0 +1,50 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _SPATIAL_H_
+#define _SPATIAL_H_
+
+#include <SDL.h>
+
+#include "widgets/widget.h"
+
+#define SPATIAL_CELL_SHIFT 6 /* 64x64 pixels cells */
+
+typedef struct spatial_cell_s {
+  widget_t **widgets;
+  int nb;
+  int size;
+} spatial_cell_t;
+
+/* uniform grid of widgets rectangles */
+typedef struct spatial_s {
+  spatial_cell_t *cells;
+  int cols;
+  int rows;
+  unsigned int stamp; /* current query, to report each widget once */
+} spatial_t;
+
+spatial_t *spatial_new (int w, int h);
+void spatial_free (spatial_t *sp);
+void spatial_insert (spatial_t *sp, widget_t *widget);
+void spatial_remove (spatial_t *sp, widget_t *widget);
+int spatial_query (spatial_t *sp, SDL_Rect *area, int from, int to,
+                   widget_t ***list, int *size);
+
+#endif /* _SPATIAL_H_ */
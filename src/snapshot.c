@@ -0,0 +1,159 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <SDL.h>
+
+#include "snapshot.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+int
+snapshot_save_ppm (SDL_Surface *srf, const char *filename)
+{
+  Uint8 *line;
+  FILE *f;
+  int x, y;
+
+  if (!srf || !filename)
+    return -1;
+
+  f = fopen (filename, "wb");
+  if (!f)
+  {
+    fprintf (stderr, "*** ERROR: can't write %s\n", filename);
+    return -1;
+  }
+
+  fprintf (f, "P6\n%d %d\n255\n", srf->w, srf->h);
+  line = malloc (3 * srf->w);
+
+  if (SDL_MUSTLOCK (srf))
+    SDL_LockSurface (srf);
+
+  for (y = 0; y < srf->h; y++)
+  {
+    Uint8 *p = (Uint8 *) srf->pixels + y * srf->pitch;
+    Uint8 a;
+
+    for (x = 0; x < srf->w; x++, p += srf->format->BytesPerPixel)
+    {
+      Uint32 pixel = 0;
+
+      switch (srf->format->BytesPerPixel)
+      {
+      case 1:
+        pixel = *p;
+        break;
+      case 2:
+        pixel = *(Uint16 *) p;
+        break;
+      case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        pixel = p[0] << 16 | p[1] << 8 | p[2];
+#else
+        pixel = p[0] | p[1] << 8 | p[2] << 16;
+#endif
+        break;
+      case 4:
+        pixel = *(Uint32 *) p;
+        break;
+      }
+
+      SDL_GetRGBA (pixel, srf->format,
+                   &line[3 * x], &line[3 * x + 1], &line[3 * x + 2], &a);
+    }
+
+    fwrite (line, 3, srf->w, f);
+  }
+
+  if (SDL_MUSTLOCK (srf))
+    SDL_UnlockSurface (srf);
+
+  free (line);
+  fclose (f);
+
+  return 0;
+}
+
+/* FNV-1a of the visible pixels, pitch padding left apart */
+uint64_t
+snapshot_hash (SDL_Surface *srf)
+{
+  uint64_t hash = FNV_OFFSET;
+  int y, i, len;
+
+  if (!srf)
+    return 0;
+
+  len = srf->w * srf->format->BytesPerPixel;
+
+  if (SDL_MUSTLOCK (srf))
+    SDL_LockSurface (srf);
+
+  for (y = 0; y < srf->h; y++)
+  {
+    Uint8 *p = (Uint8 *) srf->pixels + y * srf->pitch;
+
+    for (i = 0; i < len; i++)
+    {
+      hash ^= p[i];
+      hash *= FNV_PRIME;
+    }
+  }
+
+  if (SDL_MUSTLOCK (srf))
+    SDL_UnlockSurface (srf);
+
+  return hash;
+}
+
+/* Saves srf to pattern, where "%d" stands for the frame number,
+ * and/or prints its hash. */
+int
+snapshot_dump (SDL_Surface *srf, const char *pattern,
+               unsigned int frame, int hash)
+{
+  if (!srf)
+    return -1;
+
+  if (hash)
+    printf ("frame %u: %016" PRIx64 "\n", frame, snapshot_hash (srf));
+
+  if (pattern)
+  {
+    char filename[1024];
+    const char *num = strstr (pattern, "%d");
+
+    if (num)
+      snprintf (filename, sizeof (filename), "%.*s%u%s",
+                (int) (num - pattern), pattern, frame, num + 2);
+    else
+      snprintf (filename, sizeof (filename), "%s", pattern);
+
+    printf ("Dumping frame %u to %s\n", frame, filename);
+    return snapshot_save_ppm (srf, filename);
+  }
+
+  return 0;
+}
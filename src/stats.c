@@ -0,0 +1,271 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <SDL.h>
+#include <SDL_timer.h>
+
+#include "omc.h"
+#include "stats.h"
+#include "widgets/widget.h"
+#include "widgets/cache.h"
+#include "widgets/atlas.h"
+
+#define OVERLAY_INTERVAL 1000 /* ms */
+#define OVERLAY_FONT "examples/FreeSans.ttf"
+
+int stats_enabled = 0;
+unsigned long stats_counters[STATS_COUNTER_MAX];
+unsigned long stats_pixels[MAX_DEPTH];
+
+static const char *counter_names[STATS_COUNTER_MAX] = {
+  [STATS_FRAMES]           = "frames",
+  [STATS_WIDGETS_DRAWN]    = "widgets drawn",
+  [STATS_WIDGETS_OCCLUDED] = "widgets occluded",
+  [STATS_INVALIDATIONS]    = "redraw area invalidations",
+  [STATS_PRESENT_FLIPS]    = "full screen flips",
+  [STATS_PRESENT_RECTS]    = "damaged rects updated",
+  [STATS_IMAGES_OPAQUE]    = "images loaded opaque",
+  [STATS_IMAGES_COLORKEY]  = "images loaded colour keyed",
+  [STATS_IMAGES_ALPHA]     = "images loaded with alpha",
+  [STATS_IMAGES_PACKED]    = "images mapped from pack",
+  [STATS_IMAGES_ATLASED]   = "images put in atlas pages",
+  [STATS_CACHE_HITS]       = "image cache hits",
+  [STATS_CACHE_MISSES]     = "image cache misses",
+  [STATS_CACHE_EVICTIONS]  = "image cache evictions",
+  [STATS_WIDGETS_UNLOADED] = "widgets unloaded",
+  [STATS_WIDGETS_RELOADED] = "widgets reloaded",
+  [STATS_GLYPHS_RASTERISED] = "glyphs rasterised",
+};
+
+static stats_histo_t frame_time;
+static stats_histo_t compose_time;
+static stats_histo_t present_time;
+
+static char *stats_output;
+static int stats_overlay;
+static SDL_TimerID overlay_timer;
+static widget_t *overlay_widget;  /* only touched from the main thread */
+
+void
+stats_init (char *output, int overlay)
+{
+  stats_enabled = 1;
+  stats_output = output;
+  stats_overlay = overlay;
+}
+
+void
+stats_uninit (void)
+{
+  if (stats_enabled && stats_output)
+    stats_dump ();
+  stats_enabled = 0;
+}
+
+uint64_t
+stats_time (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+histo_add (stats_histo_t *h, uint64_t us)
+{
+  unsigned int i = us / STATS_HISTO_STEP;
+
+  if (i >= STATS_HISTO_SIZE)
+    i = STATS_HISTO_SIZE - 1;
+
+  h->count[i]++;
+  h->nb++;
+  h->sum += us;
+  if (us > h->max)
+    h->max = us;
+}
+
+/* upper bound of the bucket holding the p-th percentile, in us */
+static unsigned int
+histo_percentile (stats_histo_t *h, int p)
+{
+  unsigned int i, n = 0, target;
+
+  if (!h->nb)
+    return 0;
+
+  target = ((uint64_t) h->nb * p + 99) / 100;
+  for (i = 0; i < STATS_HISTO_SIZE; i++)
+  {
+    n += h->count[i];
+    if (n >= target)
+      break;
+  }
+
+  return (i + 1) * STATS_HISTO_STEP;
+}
+
+void
+stats_frame (uint64_t compose, uint64_t present)
+{
+  if (!stats_enabled)
+    return;
+
+  stats_counters[STATS_FRAMES]++;
+  histo_add (&compose_time, compose);
+  histo_add (&present_time, present);
+  histo_add (&frame_time, compose + present);
+}
+
+static void
+histo_print (FILE *f, const char *name, stats_histo_t *h)
+{
+  fprintf (f, "  %-10s avg %6.2f  p50 %6.2f  p99 %6.2f  max %6.2f ms\n",
+           name, h->nb ? (double) h->sum / h->nb / 1000. : 0.,
+           histo_percentile (h, 50) / 1000.,
+           histo_percentile (h, 99) / 1000., h->max / 1000.);
+}
+
+void
+stats_dump (void)
+{
+  FILE *f = stdout;
+  size_t cache_size, cache_unused;
+  size_t widget_size, widget_hidden;
+  int i;
+
+  if (!stats_enabled)
+    return;
+
+  if (stats_output && strcmp (stats_output, "-"))
+  {
+    f = fopen (stats_output, "a");
+    if (!f)
+    {
+      fprintf (stderr, "*** ERROR: can't write %s\n", stats_output);
+      return;
+    }
+  }
+
+  fprintf (f, "--- omc stats after %u frames ---\n", omc->frames);
+  histo_print (f, "frame", &frame_time);
+  histo_print (f, "compose", &compose_time);
+  histo_print (f, "present", &present_time);
+
+  for (i = 0; i < STATS_COUNTER_MAX; i++)
+    fprintf (f, "  %-28s %lu\n", counter_names[i], stats_counters[i]);
+
+  for (i = 0; i < MAX_DEPTH; i++)
+    if (stats_pixels[i])
+      fprintf (f, "  pixels blitted on layer %d   %lu\n", i, stats_pixels[i]);
+
+  cache_size = cache_bytes (&cache_unused);
+  fprintf (f, "  %-28s %lu (%lu unused)\n", "image cache bytes",
+           (unsigned long) cache_size, (unsigned long) cache_unused);
+  fprintf (f, "  %-28s %d\n", "atlas pages", atlas_pages ());
+
+  widget_size = widget_budget_bytes (&widget_hidden);
+  fprintf (f, "  %-28s %lu (%lu hidden)\n", "widget surface bytes",
+           (unsigned long) widget_size, (unsigned long) widget_hidden);
+
+  if (f != stdout)
+    fclose (f);
+  else
+    fflush (f);
+}
+
+/* runs on the SDL timer thread, the text is updated from the main one */
+static Uint32
+overlay_cb (Uint32 interval, void *param)
+{
+  SDL_Event ev;
+
+  ev.type = SDL_USEREVENT;
+  ev.user.code = STATS_EVENT;
+  ev.user.data1 = NULL;
+  ev.user.data2 = NULL;
+  SDL_PushEvent (&ev);
+
+  return interval;
+}
+
+void
+stats_overlay_update (void)
+{
+  static unsigned long last_frames;
+  static Uint32 last_ticks;
+  unsigned long frames;
+  Uint32 ticks, elapsed;
+  char str[128];
+
+  /* an event left over by a detached overlay */
+  if (!overlay_widget)
+    return;
+
+  frames = stats_counters[STATS_FRAMES];
+  ticks = SDL_GetTicks ();
+  elapsed = last_ticks ? ticks - last_ticks : OVERLAY_INTERVAL;
+  if (!elapsed)
+    elapsed = 1;
+
+  /* text_set_str() eats the last character */
+  snprintf (str, sizeof (str), "%lu fps  p50 %.1f ms  p99 %.1f ms\n",
+            (frames - last_frames) * 1000 / elapsed,
+            histo_percentile (&frame_time, 50) / 1000.,
+            histo_percentile (&frame_time, 99) / 1000.);
+  last_frames = frames;
+  last_ticks = ticks;
+
+  text_set_str (overlay_widget, str);
+}
+
+void
+stats_overlay_attach (screen_t *screen)
+{
+  widget_t *overlay;
+
+  if (!stats_enabled || !stats_overlay || !screen)
+    return;
+
+  overlay = text_new ("stats-overlay", NULL, 0, 1, MAX_DEPTH - 1,
+                      "stats", OVERLAY_FONT, 16,
+                      0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x00, 10, 10, 400, 0,
+                      NULL, NULL, NULL, NULL);
+  if (!overlay)
+    return;
+
+  screen_add_widget (screen, overlay);
+  overlay_widget = overlay;
+  overlay_timer = SDL_AddTimer (OVERLAY_INTERVAL, overlay_cb, NULL);
+}
+
+void
+stats_overlay_detach (screen_t *screen)
+{
+  if (overlay_timer)
+    SDL_RemoveTimer (overlay_timer);
+  overlay_timer = NULL;
+  overlay_widget = NULL;
+}
@@ -0,0 +1,85 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <inttypes.h>
+
+#include "screens/screen.h"
+
+/* SDL_USEREVENT code telling the main loop to call stats_overlay_update() */
+#define STATS_EVENT 0x57a7
+
+typedef enum stats_counter {
+  STATS_FRAMES,
+  STATS_WIDGETS_DRAWN,       /* widget draw calls, one per visible part */
+  STATS_WIDGETS_OCCLUDED,    /* dirty widgets fully hidden by upper ones */
+  STATS_INVALIDATIONS,       /* redraw areas set by overlapping widgets */
+  STATS_PRESENT_FLIPS,       /* frames presented as a whole */
+  STATS_PRESENT_RECTS,       /* damaged rectangles pushed to screen */
+  STATS_IMAGES_OPAQUE,       /* images loaded without any alpha */
+  STATS_IMAGES_COLORKEY,     /* images with binary alpha, colour keyed */
+  STATS_IMAGES_ALPHA,        /* images that need per-pixel alpha */
+  STATS_IMAGES_PACKED,       /* images mapped from the asset pack */
+  STATS_IMAGES_ATLASED,      /* small images sharing an atlas page */
+  STATS_CACHE_HITS,          /* images found decoded in the cache */
+  STATS_CACHE_MISSES,        /* images decoded from file */
+  STATS_CACHE_EVICTIONS,     /* unused images freed over budget */
+  STATS_WIDGETS_UNLOADED,    /* hidden widgets that dropped pixels */
+  STATS_WIDGETS_RELOADED,    /* and got them back once visible */
+  STATS_GLYPHS_RASTERISED,   /* glyphs rendered by SDL_ttf, then cached */
+  STATS_COUNTER_MAX
+} stats_counter_t;
+
+#define STATS_HISTO_STEP 100   /* us per bucket */
+#define STATS_HISTO_SIZE 1000  /* up to 100 ms, last bucket gets the rest */
+
+typedef struct stats_histo_s {
+  unsigned int count[STATS_HISTO_SIZE];
+  unsigned int nb;
+  uint64_t sum;
+  uint64_t max;
+} stats_histo_t;
+
+/* everything below is a no-op unless stats are enabled */
+extern int stats_enabled;
+extern unsigned long stats_counters[STATS_COUNTER_MAX];
+extern unsigned long stats_pixels[MAX_DEPTH];
+
+/* counters are bumped from the display, loader and compositing threads */
+#define STATS_ADD(c, n) \
+  do { if (stats_enabled) \
+      __sync_fetch_and_add (&stats_counters[c], (n)); } while (0)
+
+#define STATS_PIXELS(layer, n) \
+  do { if (stats_enabled) \
+      __sync_fetch_and_add (&stats_pixels[layer], (n)); } while (0)
+
+void stats_init (char *output, int overlay);
+void stats_uninit (void);
+uint64_t stats_time (void);
+void stats_frame (uint64_t compose, uint64_t present);
+void stats_dump (void);
+
+void stats_overlay_attach (screen_t *screen);
+void stats_overlay_detach (screen_t *screen);
+void stats_overlay_update (void);
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,292 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "omc.h"
+#include "widget.h"
+#include "display.h"
+#include "cache.h"
+#include "loader.h"
+
+/* An animation out of a single sprite sheet: frames are laid out from
+ * left to right, then top to bottom, and only the current one is blitted.
+ * The display thread advances it on its own clock, a new frame only
+ * invalidates the widget rect, and the sheet is decoded once. */
+
+#define ANIM_DEFAULT_DELAY 100 /* ms between frames */
+
+typedef struct widget_anim_s {
+  picture_t *pic;       /* sprite sheet, shared through the image cache */
+  loader_job_t *job;
+  char *name;
+  int cols, rows;
+  int nb_frames;
+  int w, h;             /* frame size, <= 0 until the sheet is known */
+  int delay;
+  int playing;
+
+  /* display thread clock */
+  int running;          /* ticked since last played */
+  Uint32 start;         /* when current cycle began */
+  int frame;            /* the one being displayed */
+} widget_anim_t;
+
+static int
+widget_anim_draw (widget_t *widget, SDL_Rect *area)
+{
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+  picture_t *pic = priv->pic;
+  SDL_Rect dst, r;
+
+  if (!pic)
+    return -1;
+
+  /* where the whole sheet would be for the frame to fall on the widget */
+  dst.x = widget->x - pic->rect.x - (priv->frame % priv->cols) * priv->w;
+  dst.y = widget->y - pic->rect.y - (priv->frame / priv->cols) * priv->h;
+  dst.w = pic->srf->w;
+  dst.h = pic->srf->h;
+
+  /* never bleed into the neighbouring frames */
+  r.x = widget->x;
+  r.y = widget->y;
+  r.w = priv->w;
+  r.h = priv->h;
+  if (!rect_intersect (area, &r, &r))
+    return 0;
+
+  return surface_blit (widget, pic->srf, dst, &r);
+}
+
+/* Frames follow the clock rather than the number of ticks, late frames
+ * are skipped instead of slowing the animation down. */
+static Uint32
+widget_anim_tick (widget_t *widget, Uint32 now)
+{
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+  Uint32 cycle = priv->delay * priv->nb_frames;
+  int frame;
+
+  /* resumes from the frame it was paused on */
+  if (!priv->running)
+  {
+    priv->start = now - priv->frame * priv->delay;
+    priv->running = 1;
+  }
+
+  if (now - priv->start >= cycle)
+    priv->start += (now - priv->start) / cycle * cycle;
+
+  frame = (now - priv->start) / priv->delay;
+  if (frame != priv->frame)
+  {
+    priv->frame = frame;
+    if (priv->pic && widget_get_flag (widget, WIDGET_FLAG_SHOW))
+      widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+  }
+
+  return priv->start + (frame + 1) * priv->delay;
+}
+
+static void
+anim_loaded (void *data, picture_t *pic)
+{
+  widget_t *widget = (widget_t *) data;
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+  picture_t *old = priv->pic;
+
+  priv->job = NULL;
+  if (!pic)
+    return;
+
+  /* sheet decoded at its original size */
+  if (priv->w <= 0 || priv->h <= 0)
+  {
+    priv->w = pic->rect.w / priv->cols;
+    priv->h = pic->rect.h / priv->rows;
+  }
+
+  priv->pic = pic;
+  widget_set_flag (widget, WIDGET_FLAG_OPAQUE, pic->opaque);
+  widget_set_rect (widget, widget->x, widget->y, priv->w, priv->h);
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+
+  /* the display thread may still be blitting the old one */
+  display_lock ();
+  cache_release (old);
+  display_unlock ();
+
+  widget_set_bytes (widget, pic->bytes);
+}
+
+static void
+anim_request (widget_t *widget, int priority)
+{
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+  int w = -1, h = -1;
+
+  /* every frame gets scaled to the widget size */
+  if (priv->w > 0 && priv->h > 0)
+  {
+    w = priv->cols * priv->w;
+    h = priv->rows * priv->h;
+  }
+
+  priv->job = loader_request (priv->name, w, h, priority,
+                              image_load, anim_loaded, widget);
+}
+
+static int
+widget_anim_action (widget_t *widget, action_event_type_t ev)
+{
+  return widget_action_default_cb (widget, ev);
+}
+
+/* hidden, neither the sheet nor the clock are kept */
+static void
+widget_anim_unload (widget_t *widget)
+{
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+  picture_t *pic = priv->pic;
+
+  display_animate (widget, 0);
+  loader_cancel (priv->job);
+  priv->job = NULL;
+  priv->pic = NULL;
+
+  display_lock ();
+  cache_release (pic);
+  display_unlock ();
+}
+
+static void
+widget_anim_reload (widget_t *widget)
+{
+  widget_anim_t *priv = (widget_anim_t *) widget->priv;
+
+  anim_request (widget, LOADER_PRIORITY_HIGH);
+  if (priv->playing)
+    display_animate (widget, 1);
+}
+
+static void
+widget_anim_free (widget_t *widget)
+{
+  widget_anim_t *priv;
+
+  if (!widget)
+    return;
+
+  priv = (widget_anim_t *) widget->priv;
+
+  loader_cancel (priv->job);
+
+  display_lock ();
+  cache_release (priv->pic);
+  display_unlock ();
+
+  if (priv->name)
+    free (priv->name);
+
+  free (priv);
+}
+
+/* cols frames per row of the sheet, one row when <= 0 */
+widget_t *
+anim_new (char *id, widget_t *parent, int show, int layer,
+          char *name, int cols, int nb_frames, int delay,
+          int x, int y, int w, int h,
+          char *sx, char *sy, char *sw, char *sh)
+{
+  widget_t *widget = NULL;
+  widget_anim_t *priv = NULL;
+  int flags = WIDGET_FLAG_NONE;
+  int x2, y2, w2, h2;
+
+  if (!name || nb_frames <= 0)
+    return NULL;
+
+  if (show)
+    flags |= WIDGET_FLAG_SHOW;
+
+  x2 = sx ? compute_coord (sx, omc->w) : x;
+  y2 = sy ? compute_coord (sy, omc->h) : y;
+  w2 = sw ? compute_coord (sw, omc->w) : w;
+  h2 = sh ? compute_coord (sh, omc->h) : h;
+
+  widget = widget_new (id, WIDGET_TYPE_ANIM, parent, flags, layer,
+                       x2, y2, w2, h2);
+
+  priv = calloc (1, sizeof (widget_anim_t));
+  printf ("Loading %s\n", name);
+  priv->name = strdup (name);
+  priv->nb_frames = nb_frames;
+  priv->cols = (cols > 0 && cols < nb_frames) ? cols : nb_frames;
+  priv->rows = (nb_frames + priv->cols - 1) / priv->cols;
+  priv->w = w2;
+  priv->h = h2;
+  priv->delay = delay > 0 ? delay : ANIM_DEFAULT_DELAY;
+  priv->playing = 1;
+
+  widget->priv = priv;
+
+  widget->draw = widget_anim_draw;
+  widget->action = widget_anim_action;
+  widget->free = widget_anim_free;
+  widget->unload = widget_anim_unload;
+  widget->reload = widget_anim_reload;
+  widget->tick = widget_anim_tick;
+
+  anim_request (widget, show ? LOADER_PRIORITY_HIGH
+                : LOADER_PRIORITY_NORMAL);
+  display_animate (widget, 1);
+
+  return widget;
+}
+
+/* paused animations keep their current frame */
+void
+anim_play (widget_t *widget, int play)
+{
+  widget_anim_t *priv;
+
+  if (!widget || widget->type != WIDGET_TYPE_ANIM)
+    return;
+
+  priv = (widget_anim_t *) widget->priv;
+  if (priv->playing == !!play)
+    return;
+
+  priv->playing = !!play;
+  if (play && widget->unloaded)
+    return;
+
+  display_animate (widget, play);
+
+  /* not ticked anymore, the clock starts again on next play */
+  if (!play)
+  {
+    display_lock ();
+    priv->running = 0;
+    display_unlock ();
+  }
+}
@@ -0,0 +1,359 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "widget.h"
+#include "display.h"
+#include "atlas.h"
+
+/* Small images are copied into a few large surfaces shared by all of
+ * them, which saves a surface and its blit setup per image. A page
+ * only holds images that are blitted the same way, i.e. with the same
+ * pixel format, colour key and alpha flags. Pages are filled by rows,
+ * or shelves, each image going to the thinnest shelf it fits in. Space
+ * is only given back at the end of a shelf or once it is empty, a page
+ * is freed once its last image is gone. */
+
+#define SHELF_ROUND 4           /* shelf heights are multiple of this */
+#define MAX_SHELVES (ATLAS_PAGE_SIZE / SHELF_ROUND)
+
+typedef struct shelf_s {
+  int y, h;
+  int x;                        /* first free column */
+  int nb_images;
+} shelf_t;
+
+struct atlas_page_s {
+  SDL_Surface *srf;
+  int nb_images;
+  int nb_unused;                /* images only kept by the cache */
+  shelf_t shelves[MAX_SHELVES];
+  int nb_shelves;
+  int top;                      /* first row below the last shelf */
+  struct atlas_page_s *next;
+};
+
+static SDL_mutex *lock;
+static atlas_page_t *pages;
+static int nb_pages;
+static size_t bytes;            /* all pages, however full */
+
+void
+atlas_init (void)
+{
+  lock = SDL_CreateMutex ();
+}
+
+void
+atlas_uninit (void)
+{
+  while (pages)
+  {
+    atlas_page_t *page = pages;
+
+    fprintf (stderr, "*** ERROR: atlas page still holds %d images\n",
+             page->nb_images);
+    pages = page->next;
+    SDL_FreeSurface (page->srf);
+    free (page);
+  }
+  nb_pages = 0;
+  bytes = 0;
+
+  SDL_DestroyMutex (lock);
+  lock = NULL;
+}
+
+static int
+page_match (atlas_page_t *page, SDL_Surface *srf)
+{
+  SDL_PixelFormat *a = page->srf->format;
+  SDL_PixelFormat *b = srf->format;
+  Uint32 flags = SDL_SRCCOLORKEY | SDL_SRCALPHA;
+
+  if (a->BitsPerPixel != b->BitsPerPixel || a->Rmask != b->Rmask
+      || a->Gmask != b->Gmask || a->Bmask != b->Bmask
+      || a->Amask != b->Amask)
+    return 0;
+
+  if ((page->srf->flags & flags) != (srf->flags & flags))
+    return 0;
+
+  if ((srf->flags & SDL_SRCCOLORKEY) && a->colorkey != b->colorkey)
+    return 0;
+
+  if ((srf->flags & SDL_SRCALPHA) && a->alpha != b->alpha)
+    return 0;
+
+  return 1;
+}
+
+static atlas_page_t *
+page_new (SDL_Surface *srf)
+{
+  SDL_PixelFormat *fmt = srf->format;
+  atlas_page_t *page;
+
+  page = calloc (1, sizeof (atlas_page_t));
+  page->srf = SDL_CreateRGBSurface (SDL_SWSURFACE,
+                                    ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE,
+                                    fmt->BitsPerPixel, fmt->Rmask,
+                                    fmt->Gmask, fmt->Bmask, fmt->Amask);
+  if (!page->srf)
+  {
+    fprintf (stderr, "*** ERROR: %s\n", SDL_GetError ());
+    free (page);
+    return NULL;
+  }
+
+  /* blitted just like the images it holds */
+  if (srf->flags & SDL_SRCCOLORKEY)
+    SDL_SetColorKey (page->srf, SDL_SRCCOLORKEY | SDL_RLEACCEL,
+                     fmt->colorkey);
+  SDL_SetAlpha (page->srf, srf->flags & SDL_SRCALPHA, fmt->alpha);
+
+  page->next = pages;
+  pages = page;
+  nb_pages++;
+  bytes += page->srf->h * page->srf->pitch;
+
+  return page;
+}
+
+static void
+page_free (atlas_page_t *page)
+{
+  atlas_page_t **p;
+
+  for (p = &pages; *p; p = &(*p)->next)
+    if (*p == page)
+    {
+      *p = page->next;
+      break;
+    }
+
+  bytes -= page->srf->h * page->srf->pitch;
+  SDL_FreeSurface (page->srf);
+  free (page);
+  nb_pages--;
+}
+
+/* finds room for a w x h image, the least height wasted the better */
+static int
+page_place (atlas_page_t *page, int w, int h, SDL_Rect *rect)
+{
+  shelf_t *best = NULL;
+  int i, sh;
+
+  for (i = 0; i < page->nb_shelves; i++)
+  {
+    shelf_t *s = &page->shelves[i];
+
+    if (s->h >= h && s->x + w <= ATLAS_PAGE_SIZE
+        && (!best || s->h < best->h))
+      best = s;
+  }
+
+  /* open a new shelf rather than waste more than half of one */
+  sh = (h + SHELF_ROUND - 1) / SHELF_ROUND * SHELF_ROUND;
+  if ((!best || best->h > 2 * sh) && page->top + sh <= ATLAS_PAGE_SIZE)
+  {
+    best = &page->shelves[page->nb_shelves++];
+    best->y = page->top;
+    best->h = sh;
+    best->x = 0;
+    best->nb_images = 0;
+    page->top += sh;
+  }
+
+  if (!best)
+    return 0;
+
+  rect->x = best->x;
+  rect->y = best->y;
+  rect->w = w;
+  rect->h = h;
+  best->x += w;
+  best->nb_images++;
+
+  return 1;
+}
+
+static void
+page_copy (atlas_page_t *page, SDL_Surface *srf, SDL_Rect *rect)
+{
+  int bpp = srf->format->BytesPerPixel;
+  Uint8 *dst;
+  int y;
+
+  /* RLE encoded pages are decoded back while locked */
+  SDL_LockSurface (page->srf);
+  if (SDL_MUSTLOCK (srf))
+    SDL_LockSurface (srf);
+
+  dst = (Uint8 *) page->srf->pixels
+    + rect->y * page->srf->pitch + rect->x * bpp;
+  for (y = 0; y < rect->h; y++)
+    memcpy (dst + y * page->srf->pitch,
+            (Uint8 *) srf->pixels + y * srf->pitch, rect->w * bpp);
+
+  if (SDL_MUSTLOCK (srf))
+    SDL_UnlockSurface (srf);
+  SDL_UnlockSurface (page->srf);
+}
+
+/* Copies srf into a shared page, and returns the page or NULL if the
+ * image has to keep its own surface. srf is left to the caller. */
+SDL_Surface *
+atlas_add (SDL_Surface *srf, atlas_page_t **page, SDL_Rect *rect)
+{
+  atlas_page_t *p;
+
+  if (!lock || !srf || srf->format->palette
+      || srf->w > ATLAS_MAX_SIZE || srf->h > ATLAS_MAX_SIZE)
+    return NULL;
+
+  /* the display thread may be blitting, or RLE encoding, the page */
+  display_lock ();
+  SDL_mutexP (lock);
+
+  for (p = pages; p; p = p->next)
+    if (page_match (p, srf) && page_place (p, srf->w, srf->h, rect))
+      break;
+
+  if (!p)
+  {
+    p = page_new (srf);
+    if (p)
+      page_place (p, srf->w, srf->h, rect);
+  }
+
+  if (p)
+  {
+    page_copy (p, srf, rect);
+    p->nb_images++;
+  }
+
+  SDL_mutexV (lock);
+  display_unlock ();
+
+  *page = p;
+
+  return p ? p->srf : NULL;
+}
+
+/* the image must not be displayed anymore */
+void
+atlas_remove (atlas_page_t *page, SDL_Rect *rect)
+{
+  int i;
+
+  if (!page)
+    return;
+
+  SDL_mutexP (lock);
+
+  if (--page->nb_images == 0)
+  {
+    page_free (page);
+    SDL_mutexV (lock);
+    return;
+  }
+
+  for (i = 0; i < page->nb_shelves; i++)
+  {
+    shelf_t *s = &page->shelves[i];
+
+    if (s->y != rect->y)
+      continue;
+
+    /* the last image of a shelf, its room can be used again */
+    if (--s->nb_images == 0)
+      s->x = 0;
+    else if (s->x == rect->x + rect->w)
+      s->x = rect->x;
+
+    /* and so can the last shelf once empty */
+    if (!s->x && i == page->nb_shelves - 1)
+    {
+      page->nb_shelves--;
+      page->top = s->y;
+    }
+    break;
+  }
+
+  SDL_mutexV (lock);
+}
+
+int
+atlas_pages (void)
+{
+  return nb_pages;
+}
+
+/* memory held by all pages */
+size_t
+atlas_bytes (void)
+{
+  size_t n;
+
+  SDL_mutexP (lock);
+  n = bytes;
+  SDL_mutexV (lock);
+
+  return n;
+}
+
+/* counts by delta the images of page nobody uses anymore, and tells
+ * whether that is all of them, i.e. whether dropping them frees it */
+int
+atlas_unused (atlas_page_t *page, int delta)
+{
+  int all;
+
+  if (!page)
+    return 0;
+
+  SDL_mutexP (lock);
+  page->nb_unused += delta;
+  all = (page->nb_unused == page->nb_images);
+  SDL_mutexV (lock);
+
+  return all;
+}
+
+/* page memory spread over the images it holds */
+size_t
+atlas_share (atlas_page_t *page)
+{
+  size_t n;
+
+  if (!page)
+    return 0;
+
+  SDL_mutexP (lock);
+  n = page->srf->h * page->srf->pitch / page->nb_images;
+  SDL_mutexV (lock);
+
+  return n;
+}
@@ -0,0 +1,42 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _ATLAS_H_
+#define _ATLAS_H_
+
+#include <SDL.h>
+
+#define ATLAS_PAGE_SIZE 512     /* width and height of shared surfaces */
+#define ATLAS_MAX_SIZE  128     /* larger images keep their own surface */
+
+typedef struct atlas_page_s atlas_page_t;
+
+void atlas_init (void);
+void atlas_uninit (void);
+
+SDL_Surface *atlas_add (SDL_Surface *srf, atlas_page_t **page,
+                        SDL_Rect *rect);
+void atlas_remove (atlas_page_t *page, SDL_Rect *rect);
+
+int atlas_pages (void);
+size_t atlas_bytes (void);
+size_t atlas_share (atlas_page_t *page);
+int atlas_unused (atlas_page_t *page, int delta);
+
+#endif /* _ATLAS_H_ */
@@ -0,0 +1,331 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "omc.h"
+#include "cache.h"
+#include "stats.h"
+
+/* Decoded images are shared by all widgets asking for the same file at
+ * the same size. Pictures nobody uses any more are kept on a LRU list
+ * and only freed once their total size, atlas pages included, exceeds
+ * the budget. Pictures may be requested from the image loader threads,
+ * decoding is done outside of the lock. */
+
+#define CACHE_BUCKETS 256
+
+static SDL_mutex *lock;
+static picture_t *buckets[CACHE_BUCKETS];
+static picture_t *lru_head;     /* least recently released */
+static picture_t *lru_tail;
+static size_t budget = CACHE_DEFAULT_BUDGET;
+static size_t bytes;            /* own surfaces of cached pictures */
+static size_t unused_bytes;     /* those on the LRU list */
+
+static unsigned int
+cache_hash (char *path, int w, int h)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*path)
+    hash = (hash ^ (unsigned char) *path++) * 16777619u;
+  hash = (hash ^ w) * 16777619u;
+  hash = (hash ^ h) * 16777619u;
+
+  return hash % CACHE_BUCKETS;
+}
+
+/* pictures on atlas pages are counted with the pages */
+static size_t
+own_bytes (picture_t *pic)
+{
+  return pic->page ? 0 : pic->bytes;
+}
+
+static void
+lru_unlink (picture_t *pic)
+{
+  if (pic->prev)
+    pic->prev->next = pic->next;
+  else
+    lru_head = pic->next;
+  if (pic->next)
+    pic->next->prev = pic->prev;
+  else
+    lru_tail = pic->prev;
+
+  pic->prev = pic->next = NULL;
+  unused_bytes -= own_bytes (pic);
+  atlas_unused (pic->page, -1);
+}
+
+static void
+lru_append (picture_t *pic)
+{
+  pic->prev = lru_tail;
+  pic->next = NULL;
+  if (lru_tail)
+    lru_tail->next = pic;
+  else
+    lru_head = pic;
+  lru_tail = pic;
+
+  unused_bytes += own_bytes (pic);
+  atlas_unused (pic->page, 1);
+}
+
+static void
+picture_free_surface (picture_t *pic)
+{
+  if (pic->page)
+    atlas_remove (pic->page, &pic->rect);
+  else
+    SDL_FreeSurface (pic->srf);
+}
+
+static void
+picture_free (picture_t *pic)
+{
+  picture_t **p;
+
+  for (p = &buckets[cache_hash (pic->path, pic->w, pic->h)]; *p;
+       p = &(*p)->hnext)
+    if (*p == pic)
+    {
+      *p = pic->hnext;
+      break;
+    }
+
+  bytes -= own_bytes (pic);
+  picture_free_surface (pic);
+  free (pic->path);
+  free (pic);
+}
+
+static void
+cache_evict (void)
+{
+  picture_t *pic, *next;
+
+  /* pages are only freed once empty: pictures sharing a page with used
+   * ones would go for nothing, and are left alone */
+  for (pic = lru_head; pic && bytes + atlas_bytes () > budget; pic = next)
+  {
+    next = pic->next;
+    if (pic->page && !atlas_unused (pic->page, 0))
+      continue;
+
+    lru_unlink (pic);
+    picture_free (pic);
+    STATS_ADD (STATS_CACHE_EVICTIONS, 1);
+  }
+}
+
+void
+cache_init (size_t size)
+{
+  budget = size;
+  lock = SDL_CreateMutex ();
+  atlas_init ();
+}
+
+void
+cache_uninit (void)
+{
+  int i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    while (buckets[i])
+    {
+      picture_t *pic = buckets[i];
+
+      if (pic->refs)
+        fprintf (stderr, "*** ERROR: %s still used %d times\n",
+                 pic->path, pic->refs);
+      else
+        lru_unlink (pic);
+      picture_free (pic);
+    }
+
+  SDL_DestroyMutex (lock);
+  lock = NULL;
+  atlas_uninit ();
+}
+
+static picture_t *
+cache_lookup (char *path, int w, int h, SDL_PixelFormat *fmt)
+{
+  picture_t *pic;
+
+  for (pic = buckets[cache_hash (path, w, h)]; pic; pic = pic->hnext)
+    if (pic->w == w && pic->h == h && !strcmp (pic->path, path)
+        && pic->bpp == fmt->BitsPerPixel && pic->rmask == fmt->Rmask)
+    {
+      if (!pic->refs++)
+        lru_unlink (pic);
+      return pic;
+    }
+
+  return NULL;
+}
+
+/* returns the picture with a new reference, loading it if needed;
+ * with no load function, only already decoded pictures are returned */
+picture_t *
+cache_get (char *path, int w, int h, cache_load_t load)
+{
+  SDL_PixelFormat *fmt = omc->display->format;
+  SDL_Surface *page;
+  picture_t *pic, *dup;
+  unsigned int hash;
+
+  if (!path)
+    return NULL;
+
+  if (w <= 0 || h <= 0)
+    w = h = 0;
+
+  SDL_mutexP (lock);
+  pic = cache_lookup (path, w, h, fmt);
+  SDL_mutexV (lock);
+
+  if (pic)
+  {
+    STATS_ADD (STATS_CACHE_HITS, 1);
+    return pic;
+  }
+
+  if (!load)
+    return NULL;
+
+  STATS_ADD (STATS_CACHE_MISSES, 1);
+
+  pic = calloc (1, sizeof (picture_t));
+  pic->srf = load (path, w, h, &pic->opaque);
+  if (!pic->srf)
+  {
+    free (pic);
+    return NULL;
+  }
+
+  pic->path = strdup (path);
+  pic->w = w;
+  pic->h = h;
+  pic->bpp = fmt->BitsPerPixel;
+  pic->rmask = fmt->Rmask;
+  pic->refs = 1;
+
+  /* small pictures share larger surfaces, but the ones mapped from the
+   * pack are used in place rather than copied */
+  pic->rect.w = pic->srf->w;
+  pic->rect.h = pic->srf->h;
+  page = NULL;
+  if (!(pic->srf->flags & SDL_PREALLOC))
+    page = atlas_add (pic->srf, &pic->page, &pic->rect);
+  if (page)
+  {
+    SDL_FreeSurface (pic->srf);
+    pic->srf = page;
+    pic->bytes = atlas_share (pic->page);
+    STATS_ADD (STATS_IMAGES_ATLASED, 1);
+  }
+  else
+    pic->bytes = pic->srf->h * pic->srf->pitch;
+
+  SDL_mutexP (lock);
+
+  /* another thread may have decoded the same file meanwhile */
+  dup = cache_lookup (path, w, h, fmt);
+  if (dup)
+  {
+    SDL_mutexV (lock);
+    picture_free_surface (pic);
+    free (pic->path);
+    free (pic);
+    return dup;
+  }
+
+  hash = cache_hash (path, w, h);
+  pic->hnext = buckets[hash];
+  buckets[hash] = pic;
+  bytes += own_bytes (pic);
+
+  /* make room for it among the unused pictures */
+  cache_evict ();
+  SDL_mutexV (lock);
+
+  return pic;
+}
+
+void
+cache_release (picture_t *pic)
+{
+  if (!pic)
+    return;
+
+  SDL_mutexP (lock);
+  if (--pic->refs == 0)
+  {
+    lru_append (pic);
+    cache_evict ();
+  }
+  SDL_mutexV (lock);
+}
+
+/* takes a reference on every cached picture, for the caller to
+ * release; returns how many there are in the newly allocated list */
+int
+cache_list (picture_t ***list)
+{
+  picture_t *pic;
+  int i, n = 0;
+
+  SDL_mutexP (lock);
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    for (pic = buckets[i]; pic; pic = pic->hnext)
+      n++;
+
+  *list = malloc ((n ? n : 1) * sizeof (picture_t *));
+  n = 0;
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    for (pic = buckets[i]; pic; pic = pic->hnext)
+    {
+      if (!pic->refs++)
+        lru_unlink (pic);
+      (*list)[n++] = pic;
+    }
+  SDL_mutexV (lock);
+
+  return n;
+}
+
+/* memory held by all decoded pictures and atlas pages, and by the
+ * pictures nobody uses that have their own surface */
+size_t
+cache_bytes (size_t *unused)
+{
+  if (unused)
+    *unused = unused_bytes;
+
+  return bytes + atlas_bytes ();
+}
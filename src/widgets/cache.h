@@ -0,0 +1,60 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <SDL.h>
+
+#include "atlas.h"
+
+#define CACHE_DEFAULT_BUDGET (32 * 1024 * 1024)
+
+/* a decoded image, ready to be blitted on the display */
+typedef struct picture_s {
+  SDL_Surface *srf;             /* may be an atlas page shared with others */
+  SDL_Rect rect;                /* part of srf holding the picture */
+  atlas_page_t *page;
+  int opaque;                   /* srf has no transparent pixel */
+
+  /* cache key */
+  char *path;
+  int w, h;                     /* requested size, <= 0 for original */
+  Uint8 bpp;                    /* display format it was converted to */
+  Uint32 rmask;
+
+  int refs;
+  size_t bytes;                 /* charged to its users, a share of the
+                                   page when on an atlas page */
+  struct picture_s *hnext;      /* same hash bucket */
+  struct picture_s *prev, *next; /* LRU list of unused pictures */
+} picture_t;
+
+typedef SDL_Surface *(*cache_load_t) (char *path, int w, int h, int *opaque);
+
+void cache_init (size_t budget);
+void cache_uninit (void);
+
+picture_t *cache_get (char *path, int w, int h, cache_load_t load);
+void cache_release (picture_t *pic);
+int cache_list (picture_t ***list);
+
+size_t cache_bytes (size_t *unused);
+
+#endif /* _CACHE_H_ */
@@ -0,0 +1,150 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <SDL_ttf.h>
+
+#include "font.h"
+
+/* Fonts are opened once per file, size and style, and shared along with
+ * their glyph cache. The glyph cache lock is what keeps a shared font
+ * from being used by several threads at once. */
+
+static font_t *fonts;
+static SDL_mutex *lock;
+
+void
+font_init (void)
+{
+  lock = SDL_CreateMutex ();
+}
+
+static void
+font_free (font_t *font)
+{
+  glyph_cache_free (font->glyphs);
+  TTF_CloseFont (font->ttf);
+  free (font->file);
+  free (font);
+}
+
+void
+font_uninit (void)
+{
+  while (fonts)
+  {
+    font_t *font = fonts;
+
+    fonts = font->next;
+    fprintf (stderr, "*** ERROR: %s still used %d times\n",
+             font->file, font->refs);
+    font_free (font);
+  }
+
+  SDL_DestroyMutex (lock);
+  lock = NULL;
+}
+
+static font_t *
+font_open (char *file, int size, int style)
+{
+  font_t *font;
+  TTF_Font *ttf;
+
+  ttf = TTF_OpenFont (file, size);
+  if (!ttf)
+  {
+    fprintf (stderr, "*** ERROR: %s\n", SDL_GetError ());
+    return NULL;
+  }
+
+  TTF_SetFontStyle (ttf, style & ~FONT_TABULAR);
+
+  font = calloc (1, sizeof (font_t));
+  font->file = strdup (file);
+  font->size = size;
+  font->style = style;
+  font->ttf = ttf;
+  font->glyphs = glyph_cache_new (ttf, style & FONT_TABULAR);
+
+  return font;
+}
+
+/* Returns a reference to the font, to be given back with font_release(),
+ * NULL if it can't be opened. */
+font_t *
+font_get (char *file, int size, int style)
+{
+  font_t *font;
+
+  if (!file)
+    return NULL;
+
+  SDL_mutexP (lock);
+  for (font = fonts; font; font = font->next)
+    if (font->size == size && font->style == style
+        && !strcmp (font->file, file))
+      break;
+
+  if (!font)
+  {
+    font = font_open (file, size, style);
+    if (font)
+    {
+      font->next = fonts;
+      fonts = font;
+    }
+  }
+
+  if (font)
+    font->refs++;
+  SDL_mutexV (lock);
+
+  return font;
+}
+
+/* closed along with its glyphs once unused */
+void
+font_release (font_t *font)
+{
+  font_t **f;
+
+  if (!font)
+    return;
+
+  SDL_mutexP (lock);
+  if (--font->refs)
+  {
+    SDL_mutexV (lock);
+    return;
+  }
+
+  for (f = &fonts; *f; f = &(*f)->next)
+    if (*f == font)
+    {
+      *f = font->next;
+      break;
+    }
+  SDL_mutexV (lock);
+
+  font_free (font);
+}
@@ -0,0 +1,47 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _FONT_H_
+#define _FONT_H_
+
+#include <SDL_ttf.h>
+
+#include "glyph.h"
+
+/* not a TTF style, digits all get the same advance */
+#define FONT_TABULAR 0x100
+
+/* an opened font, shared by all the text using it */
+typedef struct font_s {
+  char *file;           /* registry key */
+  int size;
+  int style;
+  TTF_Font *ttf;
+  glyph_cache_t *glyphs;
+  int refs;
+  struct font_s *next;
+} font_t;
+
+void font_init (void);
+void font_uninit (void);
+
+font_t *font_get (char *file, int size, int style);
+void font_release (font_t *font);
+
+#endif /* _FONT_H_ */
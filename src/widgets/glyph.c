@@ -0,0 +1,636 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <SDL_ttf.h>
+
+#include "omc.h"
+#include "glyph.h"
+#include "stats.h"
+
+/* Glyphs are rasterised once by SDL_ttf and kept as alpha masks with
+ * their metrics. Strings are then measured from cached advances and
+ * drawn by blending the masks with a colour, either into a transparent
+ * surface or straight onto another one. */
+
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef MIN
+#define MIN(a,b) ((a) > (b) ? (b) : (a))
+#endif
+
+glyph_cache_t *
+glyph_cache_new (TTF_Font *font, int tabular)
+{
+  glyph_cache_t *cache;
+  int ch, advance;
+
+  if (!font)
+    return NULL;
+
+  cache = calloc (1, sizeof (glyph_cache_t));
+  cache->font = font;
+  cache->style = TTF_GetFontStyle (font);
+  cache->ascent = TTF_FontAscent (font);
+  cache->height = TTF_FontHeight (font);
+  cache->lineskip = TTF_FontLineSkip (font);
+  cache->lock = SDL_CreateMutex ();
+
+  /* room for the widest digit */
+  if (tabular)
+    for (ch = '0'; ch <= '9'; ch++)
+      if (!TTF_GlyphMetrics (font, ch, NULL, NULL, NULL, NULL, &advance))
+        cache->digit_advance = MAX (cache->digit_advance, advance);
+
+  return cache;
+}
+
+void
+glyph_cache_free (glyph_cache_t *cache)
+{
+  int i;
+
+  if (!cache)
+    return;
+
+  for (i = 0; i < GLYPH_HASH_SIZE; i++)
+    while (cache->glyphs[i])
+    {
+      glyph_t *glyph = cache->glyphs[i];
+
+      cache->glyphs[i] = glyph->next;
+      free (glyph->mask);
+      free (glyph);
+    }
+
+  SDL_DestroyMutex (cache->lock);
+  free (cache);
+}
+
+/* Decodes the character str points to, and moves past it. Bytes that are
+ * not valid UTF-8 are taken as latin-1.
+ * Returns 0 at the end of the string. */
+Uint16
+glyph_utf8_next (char **str)
+{
+  Uint8 *s = (Uint8 *) *str;
+  Uint32 ch;
+  int i, n;
+
+  if (!s[0])
+    return 0;
+
+  if (s[0] < 0x80)
+  {
+    *str += 1;
+    return s[0];
+  }
+
+  if ((s[0] & 0xE0) == 0xC0)
+  {
+    n = 1;
+    ch = s[0] & 0x1F;
+  }
+  else if ((s[0] & 0xF0) == 0xE0)
+  {
+    n = 2;
+    ch = s[0] & 0x0F;
+  }
+  else if ((s[0] & 0xF8) == 0xF0)
+  {
+    n = 3;
+    ch = s[0] & 0x07;
+  }
+  else
+    n = 0;
+
+  for (i = 1; i <= n; i++)
+  {
+    if ((s[i] & 0xC0) != 0x80)
+      break;
+    ch = (ch << 6) | (s[i] & 0x3F);
+  }
+
+  if (!n || i <= n || !ch)
+  {
+    *str += 1;
+    return s[0];
+  }
+
+  *str += n + 1;
+
+  /* SDL_ttf only knows about the basic multilingual plane */
+  return ch > 0xFFFF ? 0xFFFD : ch;
+}
+
+/* keeps the coverage of what SDL_ttf renders for a single glyph */
+static glyph_t *
+glyph_load (glyph_cache_t *cache, Uint16 ch)
+{
+  SDL_Color white = { 0xFF, 0xFF, 0xFF, 0 };
+  SDL_Surface *srf;
+  glyph_t *glyph;
+  int x, y;
+
+  glyph = calloc (1, sizeof (glyph_t));
+  glyph->ch = ch;
+
+  /* unknown glyphs take no room */
+  srf = NULL;
+  if (TTF_GlyphMetrics (cache->font, ch, &glyph->minx, &glyph->maxx,
+                        &glyph->miny, &glyph->maxy, &glyph->advance) < 0)
+    glyph->minx = glyph->maxx = glyph->miny = glyph->maxy =
+      glyph->advance = 0;
+  else
+    srf = TTF_RenderGlyph_Blended (cache->font, ch, white);
+
+  /* tabular digits are centred in cells of the same width */
+  if (cache->digit_advance && ch >= '0' && ch <= '9')
+  {
+    int shift = (cache->digit_advance - glyph->advance) / 2;
+
+    glyph->minx += shift;
+    glyph->maxx += shift;
+    glyph->advance = cache->digit_advance;
+  }
+  if (srf && srf->w && srf->h && srf->format->BytesPerPixel == 4)
+  {
+    SDL_PixelFormat *fmt = srf->format;
+
+    glyph->w = srf->w;
+    glyph->h = srf->h;
+    glyph->mask = malloc (glyph->w * glyph->h);
+
+    SDL_LockSurface (srf);
+    for (y = 0; y < glyph->h; y++)
+    {
+      Uint32 *p = (Uint32 *) ((Uint8 *) srf->pixels + y * srf->pitch);
+      Uint8 *m = glyph->mask + y * glyph->w;
+
+      for (x = 0; x < glyph->w; x++)
+        m[x] = ((p[x] & fmt->Amask) >> fmt->Ashift) << fmt->Aloss;
+    }
+    SDL_UnlockSurface (srf);
+  }
+  if (srf)
+    SDL_FreeSurface (srf);
+
+  glyph->next = cache->glyphs[ch % GLYPH_HASH_SIZE];
+  cache->glyphs[ch % GLYPH_HASH_SIZE] = glyph;
+  cache->nb_glyphs++;
+  cache->bytes += sizeof (glyph_t) + glyph->w * glyph->h;
+  STATS_ADD (STATS_GLYPHS_RASTERISED, 1);
+
+  return glyph;
+}
+
+/* caller holds the cache lock */
+static glyph_t *
+glyph_get (glyph_cache_t *cache, Uint16 ch)
+{
+  glyph_t *glyph;
+
+  for (glyph = cache->glyphs[ch % GLYPH_HASH_SIZE]; glyph;
+       glyph = glyph->next)
+    if (glyph->ch == ch)
+      return glyph;
+
+  return glyph_load (cache, ch);
+}
+
+/* Same box as SDL_ttf gives, from the leftmost pixel to the farthest of
+ * the last advance and the rightmost pixel. */
+typedef struct glyph_box_s {
+  int x;                /* pen */
+  int x0, x1;
+} glyph_box_t;
+
+static void
+glyph_box_add (glyph_box_t *box, glyph_t *glyph)
+{
+  box->x0 = MIN (box->x0, box->x + glyph->minx);
+  box->x1 = MAX (box->x1, box->x + MAX (glyph->advance, glyph->maxx));
+  box->x += glyph->advance;
+}
+
+/* minx is where the pen starts from, glyphs may hang left of it.
+ * Caller holds the cache lock. */
+static int
+glyph_measure (glyph_cache_t *cache, char *str, int *minx)
+{
+  glyph_box_t box = { 0, 0, 0 };
+  Uint16 ch;
+
+  while ((ch = glyph_utf8_next (&str)))
+    glyph_box_add (&box, glyph_get (cache, ch));
+
+  if (minx)
+    *minx = box.x0;
+
+  return box.x1 - box.x0;
+}
+
+int
+glyph_size (glyph_cache_t *cache, char *str, int *w, int *h)
+{
+  int width;
+
+  if (!cache || !str)
+    return -1;
+
+  SDL_mutexP (cache->lock);
+  width = glyph_measure (cache, str, NULL);
+  SDL_mutexV (cache->lock);
+
+  if (w)
+    *w = width;
+  if (h)
+    *h = cache->height;
+
+  return 0;
+}
+
+/* pixels a glyph may touch, relative to the pen */
+static void
+glyph_span (glyph_t *glyph, int x, int *x0, int *x1)
+{
+  *x0 = MIN (*x0, x + glyph->minx);
+  *x1 = MAX (*x1, x + MAX (glyph->maxx, glyph->minx + glyph->w));
+}
+
+/* Compares str with old, as they would be drawn in boxes of the same
+ * size. Characters that changed, or moved, are the only ones to be drawn
+ * again: x0 and x1 get the columns they cover, in both strings.
+ * Returns whether anything changed. */
+int
+glyph_diff (glyph_cache_t *cache, char *old, char *str, int *x0, int *x1)
+{
+  int xo, xn, minx;
+  Uint16 co = 1, cn = 1;
+
+  if (!cache || !old || !str || !x0 || !x1)
+    return -1;
+
+  *x0 = INT_MAX;
+  *x1 = INT_MIN;
+
+  SDL_mutexP (cache->lock);
+
+  /* pens start right of the glyphs hanging left */
+  glyph_measure (cache, old, &minx);
+  xo = -minx;
+  glyph_measure (cache, str, &minx);
+  xn = -minx;
+
+  while (1)
+  {
+    glyph_t *go = NULL, *gn = NULL;
+
+    if (co)
+      co = glyph_utf8_next (&old);
+    if (cn)
+      cn = glyph_utf8_next (&str);
+    if (!co && !cn)
+      break;
+
+    if (co)
+      go = glyph_get (cache, co);
+    if (cn)
+      gn = glyph_get (cache, cn);
+
+    if (co != cn || xo != xn)
+    {
+      if (go)
+        glyph_span (go, xo, x0, x1);
+      if (gn)
+        glyph_span (gn, xn, x0, x1);
+    }
+
+    if (go)
+      xo += go->advance;
+    if (gn)
+      xn += gn->advance;
+  }
+
+  SDL_mutexV (cache->lock);
+
+  return *x1 > *x0;
+}
+
+/* Finds the longest prefix of str that fits within width once ellipsis,
+ * if not NULL, is appended. Prefix boxes only grow, so characters are
+ * walked once and no further than the first one that overflows.
+ * Returns the length of the prefix in bytes, w gets the width of the
+ * whole, ellipsis included when str had to be cut. */
+int
+glyph_fit (glyph_cache_t *cache, char *str, int width, char *ellipsis,
+           int *w)
+{
+  glyph_box_t box = { 0, 0, 0 }, dots = { 0, 0, 0 };
+  char *s, *end;
+  int len = 0, fit = 0;
+  Uint16 ch;
+
+  if (!cache || !str)
+    return -1;
+
+  SDL_mutexP (cache->lock);
+
+  if (ellipsis)
+    for (s = ellipsis; (ch = glyph_utf8_next (&s));)
+      glyph_box_add (&dots, glyph_get (cache, ch));
+
+  for (s = end = str; (ch = glyph_utf8_next (&end)); s = end)
+  {
+    glyph_box_t next = box;
+
+    /* prefix up to s, followed by the ellipsis */
+    if (MAX (box.x1, box.x + dots.x1) - MIN (box.x0, box.x + dots.x0)
+        <= width)
+    {
+      len = s - str;
+      fit = MAX (box.x1, box.x + dots.x1) - MIN (box.x0, box.x + dots.x0);
+    }
+
+    glyph_box_add (&next, glyph_get (cache, ch));
+    if (width > 0 && next.x1 - next.x0 > width)
+      break;
+    box = next;
+  }
+
+  /* everything fits, there is nothing to cut */
+  if (!ch)
+  {
+    len = s - str;
+    fit = box.x1 - box.x0;
+  }
+
+  SDL_mutexV (cache->lock);
+
+  if (w)
+    *w = fit;
+
+  return len;
+}
+
+/* Breaks the line starting at text + start after the last word that fits
+ * within width, or within its first word when even that one is too long.
+ * A line always gets at least one character. Lines also end at newlines,
+ * spaces before the next line are skipped.
+ * Returns 0, -1 on error. */
+int
+glyph_wrap (glyph_cache_t *cache, char *text, int start, int width,
+            glyph_line_t *line)
+{
+  glyph_box_t box, fit = { 0, 0, 0 };
+  glyph_t *space;
+  char *s, *p, *q;
+  int len = 0;
+
+  if (!cache || !text || !line)
+    return -1;
+
+  line->start = start;
+  line->overflow = INT_MAX;
+  s = text + start;
+
+  SDL_mutexP (cache->lock);
+  space = glyph_get (cache, ' ');
+
+  while (1)
+  {
+    /* spaces only count when a word follows them */
+    box = fit;
+    for (p = s; *p == ' '; p++)
+      glyph_box_add (&box, space);
+
+    if (!*p || *p == '\n')
+    {
+      line->next = *p ? p + 1 - text : p - text;
+      line->scan = p - text;
+      break;
+    }
+
+    /* words go in as a whole, or the line ends right before them */
+    for (q = p; *q && *q != ' ' && *q != '\n';)
+    {
+      char *c = q;
+      glyph_box_t more = box;
+
+      glyph_box_add (&more, glyph_get (cache, glyph_utf8_next (&q)));
+      if (width > 0 && more.x1 - more.x0 > width
+          && line->overflow == INT_MAX)
+      {
+        line->overflow = more.x1 - more.x0;
+
+        /* a first word too long is cut where it overflows */
+        if (!len)
+        {
+          if (c == p && c == s)
+          {
+            /* not even one character fits, it has to go anyway */
+            box = more;
+            c = q;
+          }
+          fit = box;
+          len = c - s;
+          line->next = c - text;
+          line->scan = q - 1 - text;
+          goto done;
+        }
+      }
+      box = more;
+    }
+
+    line->scan = q - text;
+    if (line->overflow != INT_MAX)
+    {
+      line->overflow = box.x1 - box.x0;
+      line->next = p - text;
+      break;
+    }
+
+    fit = box;
+    len = q - s;
+    s = q;
+  }
+
+ done:
+  SDL_mutexV (cache->lock);
+
+  line->len = len;
+  line->w = fit.x1 - fit.x0;
+
+  return 0;
+}
+
+/* Blends colour through the mask, the destination alpha channel, if any,
+ * gets the coverage added. */
+static void
+glyph_blend (glyph_t *glyph, SDL_Color color, SDL_Surface *dst,
+             int x, int y, SDL_Rect *clip)
+{
+  SDL_PixelFormat *fmt = dst->format;
+  int bpp = fmt->BytesPerPixel;
+  int x0, y0, w, h, i, j;
+
+  /* SDL_Rect sizes are unsigned, the glyph may miss the clip */
+  x0 = MAX (x, clip->x);
+  y0 = MAX (y, clip->y);
+  w = MIN (x + glyph->w, clip->x + clip->w) - x0;
+  h = MIN (y + glyph->h, clip->y + clip->h) - y0;
+  if (w <= 0 || h <= 0)
+    return;
+
+  for (j = 0; j < h; j++)
+  {
+    Uint8 *m = glyph->mask + (y0 - y + j) * glyph->w + x0 - x;
+    Uint8 *d = (Uint8 *) dst->pixels + (y0 + j) * dst->pitch + x0 * bpp;
+
+    for (i = 0; i < w; i++, d += bpp)
+    {
+      Uint32 a = m[i], p, cr, cg, cb, ca;
+
+      if (!a)
+        continue;
+
+      p = bpp == 4 ? *(Uint32 *) d : *(Uint16 *) d;
+      cr = ((p & fmt->Rmask) >> fmt->Rshift) << fmt->Rloss;
+      cg = ((p & fmt->Gmask) >> fmt->Gshift) << fmt->Gloss;
+      cb = ((p & fmt->Bmask) >> fmt->Bshift) << fmt->Bloss;
+      ca = 255;
+
+      if (fmt->Amask)
+      {
+        /* over operator, the colour is weighted by both coverages */
+        Uint32 da = ((p & fmt->Amask) >> fmt->Ashift) << fmt->Aloss;
+        Uint32 wd = da * (255 - a) / 255;
+
+        ca = a + wd;
+        cr = (color.r * a + cr * wd) / ca;
+        cg = (color.g * a + cg * wd) / ca;
+        cb = (color.b * a + cb * wd) / ca;
+      }
+      else
+      {
+        cr = cr + ((int) color.r - (int) cr) * (int) a / 255;
+        cg = cg + ((int) color.g - (int) cg) * (int) a / 255;
+        cb = cb + ((int) color.b - (int) cb) * (int) a / 255;
+      }
+
+      p = ((cr >> fmt->Rloss) << fmt->Rshift)
+        | ((cg >> fmt->Gloss) << fmt->Gshift)
+        | ((cb >> fmt->Bloss) << fmt->Bshift)
+        | (((ca >> fmt->Aloss) << fmt->Ashift) & fmt->Amask);
+
+      if (bpp == 4)
+        *(Uint32 *) d = p;
+      else
+        *(Uint16 *) d = p;
+    }
+  }
+}
+
+/* Draws str with its box top left corner at (x, y), only within clip
+ * when given. dst has to be a 16 or 32 bits surface.
+ * Returns the width of the box, -1 on error. */
+int
+glyph_draw (glyph_cache_t *cache, char *str, SDL_Color color,
+            SDL_Surface *dst, int x, int y, SDL_Rect *clip)
+{
+  SDL_Rect r = { 0, 0, 0, 0 };
+  int w, h, minx;
+  Uint16 ch;
+
+  if (!cache || !str || !dst)
+    return -1;
+
+  if (dst->format->BytesPerPixel != 2 && dst->format->BytesPerPixel != 4)
+    return -1;
+
+  w = dst->w;
+  h = dst->h;
+  if (clip)
+  {
+    r.x = MAX (clip->x, 0);
+    r.y = MAX (clip->y, 0);
+    w = MIN (clip->x + clip->w, dst->w) - r.x;
+    h = MIN (clip->y + clip->h, dst->h) - r.y;
+  }
+  r.w = MAX (w, 0);
+  r.h = MAX (h, 0);
+
+  SDL_mutexP (cache->lock);
+  w = glyph_measure (cache, str, &minx);
+
+  if (r.w && r.h)
+  {
+    if (SDL_MUSTLOCK (dst))
+      SDL_LockSurface (dst);
+
+    /* the pen starts right of the glyphs hanging left */
+    x -= minx;
+    while ((ch = glyph_utf8_next (&str)))
+    {
+      glyph_t *glyph = glyph_get (cache, ch);
+
+      if (glyph->mask)
+        glyph_blend (glyph, color, dst, x + glyph->minx,
+                     y + cache->ascent - glyph->maxy, &r);
+      x += glyph->advance;
+    }
+
+    if (SDL_MUSTLOCK (dst))
+      SDL_UnlockSurface (dst);
+  }
+  SDL_mutexV (cache->lock);
+
+  return w;
+}
+
+/* A transparent surface holding str, like TTF_RenderUTF8_Blended() gives.
+ * Returns NULL for empty strings. */
+SDL_Surface *
+glyph_render (glyph_cache_t *cache, char *str, SDL_Color color)
+{
+  SDL_Surface *srf;
+  int w;
+
+  if (glyph_size (cache, str, &w, NULL) < 0 || !w)
+    return NULL;
+
+  srf = SDL_CreateRGBSurface (SDL_SWSURFACE, w, cache->height, 32,
+                              0x00FF0000, 0x0000FF00, 0x000000FF,
+                              0xFF000000);
+  if (!srf)
+  {
+    fprintf (stderr, "*** ERROR: %s\n", SDL_GetError ());
+    return NULL;
+  }
+
+  glyph_draw (cache, str, color, srf, 0, 0, NULL);
+
+  return srf;
+}
@@ -0,0 +1,81 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _GLYPH_H_
+#define _GLYPH_H_
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#define GLYPH_HASH_SIZE 256     /* latin-1 glyphs never share a bucket */
+
+/* a rasterised glyph, as an alpha mask */
+typedef struct glyph_s {
+  Uint16 ch;
+  int minx, maxx;       /* bounding box, relative to the pen */
+  int miny, maxy;
+  int advance;
+  Uint8 *mask;          /* w x h coverage, NULL for blank glyphs */
+  int w, h;
+  struct glyph_s *next; /* same hash bucket */
+} glyph_t;
+
+/* glyphs of a font, at the size and style it has been opened with */
+typedef struct glyph_cache_s {
+  TTF_Font *font;
+  int style;
+  int ascent;
+  int height;
+  int lineskip;         /* between baselines of consecutive lines */
+  int digit_advance;    /* of all digits when tabular, else 0 */
+  glyph_t *glyphs[GLYPH_HASH_SIZE];
+  int nb_glyphs;
+  size_t bytes;
+  SDL_mutex *lock;      /* text may be rendered from timer threads */
+} glyph_cache_t;
+
+/* a line of wrapped text, offsets are from the start of the text */
+typedef struct glyph_line_s {
+  int start;
+  int len;              /* bytes drawn, trailing spaces excluded */
+  int next;             /* where the following line starts */
+  int scan;             /* last byte looked at to break the line */
+  int w;
+  int overflow;         /* width from which more would fit, INT_MAX when
+                           a newline or the end of text breaks it */
+} glyph_line_t;
+
+glyph_cache_t *glyph_cache_new (TTF_Font *font, int tabular);
+void glyph_cache_free (glyph_cache_t *cache);
+
+Uint16 glyph_utf8_next (char **str);
+
+int glyph_size (glyph_cache_t *cache, char *str, int *w, int *h);
+int glyph_diff (glyph_cache_t *cache, char *old, char *str,
+                int *x0, int *x1);
+int glyph_fit (glyph_cache_t *cache, char *str, int width, char *ellipsis,
+               int *w);
+int glyph_wrap (glyph_cache_t *cache, char *text, int start, int width,
+                glyph_line_t *line);
+int glyph_draw (glyph_cache_t *cache, char *str, SDL_Color color,
+                SDL_Surface *dst, int x, int y, SDL_Rect *clip);
+SDL_Surface *glyph_render (glyph_cache_t *cache, char *str,
+                           SDL_Color color);
+
+#endif /* _GLYPH_H_ */
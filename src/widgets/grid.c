@@ -0,0 +1,535 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "omc.h"
+#include "widget.h"
+#include "display.h"
+#include "blit.h"
+#include "cache.h"
+#include "loader.h"
+
+/* A grid of thumbnails over any number of items. Only a pool of cells,
+ * enough for the visible rows and a few more around them, is ever
+ * allocated: item i always goes to the same cell of the pool, which is
+ * given another item when scrolled out. Visible cells are composited
+ * once into a view surface, blitted as a whole by the display thread,
+ * and scrolling moves its pixels instead of painting everything again.
+ * Neither memory nor frame time depend on the number of items. */
+
+#define GRID_PREFETCH_ROWS 1    /* decoded ahead, above and below the view */
+#define GRID_MARGIN        4    /* around thumbnails, room for the focus */
+
+typedef struct grid_cell_s {
+  widget_t *widget;
+  int index;            /* item shown, -1 for none */
+  int priority;         /* of the pending load */
+  picture_t *pic;
+  loader_job_t *job;
+} grid_cell_t;
+
+typedef struct widget_grid_s {
+  SDL_Surface *view;    /* visible rows, as composited */
+  int cell_w, cell_h;
+  int cols, rows;       /* visible cells, the last row may be cut */
+  int pool_rows;
+  grid_cell_t *cells;
+  size_t pic_bytes;
+  int nb_items;
+  grid_item_t item;
+  void *data;
+  int top;              /* first visible row */
+  int sel;              /* selected item */
+} widget_grid_t;
+
+static grid_cell_t *
+grid_cell (widget_grid_t *priv, int index)
+{
+  int row = index / priv->cols;
+
+  return &priv->cells[(row % priv->pool_rows) * priv->cols
+                      + index % priv->cols];
+}
+
+static int
+grid_visible (widget_grid_t *priv, int index)
+{
+  int row = index / priv->cols;
+
+  return index >= 0 && index < priv->nb_items
+    && row >= priv->top && row < priv->top + priv->rows;
+}
+
+static void
+grid_account (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  SDL_Surface *view = priv->view;
+
+  widget_set_bytes (widget, priv->pic_bytes
+                    + (view ? view->h * view->pitch : 0));
+}
+
+/* paints a visible cell into the view, caller holds the display lock */
+static void
+grid_paint (widget_t *widget, int index)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  grid_cell_t *cell = grid_cell (priv, index);
+  SDL_Surface *view = priv->view;
+  int row = index / priv->cols;
+  int focus;
+  SDL_Rect r;
+
+  if (!view || index < 0 || row < priv->top || row >= priv->top + priv->rows)
+    return;
+
+  r.x = (index % priv->cols) * priv->cell_w;
+  r.y = (row - priv->top) * priv->cell_h;
+  r.w = priv->cell_w;
+  r.h = priv->cell_h;
+
+  /* the focus is a frame in the margin around the thumbnail */
+  focus = index == priv->sel && index < priv->nb_items
+    && widget_get_flag (widget, WIDGET_FLAG_FOCUSED);
+  SDL_FillRect (view, &r, focus ? SDL_MapRGB (view->format, 0xff, 0xff, 0xff)
+                : SDL_MapRGB (view->format, 0, 0, 0));
+  if (focus)
+  {
+    r.x += GRID_MARGIN;
+    r.y += GRID_MARGIN;
+    r.w -= 2 * GRID_MARGIN;
+    r.h -= 2 * GRID_MARGIN;
+    SDL_FillRect (view, &r, SDL_MapRGB (view->format, 0, 0, 0));
+  }
+
+  if (index < priv->nb_items && cell->index == index && cell->pic)
+  {
+    SDL_Rect src = cell->pic->rect;
+    SDL_Rect dst;
+
+    dst.x = (index % priv->cols) * priv->cell_w + (priv->cell_w - src.w) / 2;
+    dst.y = (row - priv->top) * priv->cell_h + (priv->cell_h - src.h) / 2;
+    dst.w = src.w;
+    dst.h = src.h;
+    if (blit_alpha (cell->pic->srf, &src, view, &dst) < 0)
+      SDL_BlitSurface (cell->pic->srf, &src, view, &dst);
+  }
+}
+
+static void
+grid_paint_rows (widget_t *widget, int first, int last)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  int i;
+
+  display_lock ();
+  for (i = first * priv->cols; i < last * priv->cols; i++)
+    grid_paint (widget, i);
+  display_unlock ();
+
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+}
+
+static void
+grid_cell_clear (widget_grid_t *priv, grid_cell_t *cell)
+{
+  picture_t *pic = cell->pic;
+
+  loader_cancel (cell->job);
+  cell->job = NULL;
+  cell->pic = NULL;
+  cell->index = -1;
+
+  if (pic)
+  {
+    priv->pic_bytes -= pic->bytes;
+
+    /* it may be being copied to the view */
+    display_lock ();
+    cache_release (pic);
+    display_unlock ();
+  }
+}
+
+static void
+grid_loaded (void *data, picture_t *pic)
+{
+  grid_cell_t *cell = (grid_cell_t *) data;
+  widget_t *widget = cell->widget;
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+
+  cell->job = NULL;
+  if (!pic)
+    return;
+
+  cell->pic = pic;
+  priv->pic_bytes += pic->bytes;
+  grid_account (widget);
+
+  if (grid_visible (priv, cell->index))
+  {
+    display_lock ();
+    grid_paint (widget, cell->index);
+    display_unlock ();
+    widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+  }
+}
+
+/* hands the cells over to the items in and around the view */
+static void
+grid_update_cells (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  int row, i;
+
+  if (!priv->view || !priv->item)
+    return;
+
+  for (row = priv->top - GRID_PREFETCH_ROWS;
+       row < priv->top + priv->rows + GRID_PREFETCH_ROWS; row++)
+    for (i = row * priv->cols; i < (row + 1) * priv->cols; i++)
+    {
+      grid_cell_t *cell;
+      int priority;
+
+      if (i < 0 || i >= priv->nb_items)
+        continue;
+
+      cell = grid_cell (priv, i);
+      priority = grid_visible (priv, i) ? LOADER_PRIORITY_HIGH
+        : LOADER_PRIORITY_LOW;
+
+      /* already there, or coming soon enough */
+      if (cell->index == i && (cell->pic || cell->priority >= priority))
+        continue;
+
+      grid_cell_clear (priv, cell);
+      cell->index = i;
+      cell->priority = priority;
+      cell->job = loader_request (priv->item (priv->data, i),
+                                  priv->cell_w - 2 * GRID_MARGIN,
+                                  priv->cell_h - 2 * GRID_MARGIN,
+                                  priority, image_load, grid_loaded, cell);
+    }
+
+  grid_account (widget);
+}
+
+static void
+grid_scroll (widget_t *widget, int top)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  SDL_Surface *view = priv->view;
+  int d = top - priv->top;
+  int first = 0, last = priv->rows;
+
+  if (!d)
+    return;
+
+  priv->top = top;
+
+  /* rows still visible are moved, only new ones get painted */
+  if (view && abs (d) < priv->rows)
+  {
+    int len = (priv->rows - abs (d)) * priv->cell_h * view->pitch;
+    int shift = abs (d) * priv->cell_h * view->pitch;
+    Uint8 *p = (Uint8 *) view->pixels;
+
+    display_lock ();
+    if (d > 0)
+    {
+      memmove (p, p + shift, len);
+      first = priv->rows - d;
+    }
+    else
+    {
+      memmove (p + shift, p, len);
+      last = -d;
+    }
+    display_unlock ();
+  }
+
+  grid_update_cells (widget);
+  grid_paint_rows (widget, priv->top + first, priv->top + last);
+}
+
+static void
+grid_select (widget_t *widget, int index)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  int old = priv->sel;
+  int row, full;
+
+  if (index < 0 || index >= priv->nb_items || index == old)
+    return;
+
+  priv->sel = index;
+
+  /* keep the selection within the fully visible rows */
+  row = index / priv->cols;
+  full = MAX (widget->h / priv->cell_h, 1);
+  if (row < priv->top)
+    grid_scroll (widget, row);
+  else if (row >= priv->top + full)
+    grid_scroll (widget, row - full + 1);
+
+  display_lock ();
+  grid_paint (widget, old);
+  grid_paint (widget, index);
+  display_unlock ();
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+}
+
+static int
+widget_grid_draw (widget_t *widget, SDL_Rect *area)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  SDL_Rect dst;
+
+  if (!priv->view)
+    return -1;
+
+  dst.x = widget->x;
+  dst.y = widget->y;
+  dst.w = priv->view->w;
+  dst.h = priv->view->h;
+
+  return surface_blit (widget, priv->view, dst, area);
+}
+
+static int
+widget_grid_set_focus (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+
+  display_lock ();
+  grid_paint (widget, priv->sel);
+  display_unlock ();
+
+  return 0;
+}
+
+static int
+widget_grid_action (widget_t *widget, action_event_type_t ev)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  int sel = priv->sel;
+  int col = sel % priv->cols;
+
+  /* leaving the grid from its borders only */
+  switch (ev)
+  {
+  case ACTION_EVENT_GO_LEFT:
+    if (col > 0)
+      sel--;
+    break;
+  case ACTION_EVENT_GO_RIGHT:
+    if (col < priv->cols - 1 && sel + 1 < priv->nb_items)
+      sel++;
+    break;
+  case ACTION_EVENT_GO_UP:
+    if (sel >= priv->cols)
+      sel -= priv->cols;
+    break;
+  case ACTION_EVENT_GO_DOWN:
+    if (sel + priv->cols < priv->nb_items)
+      sel += priv->cols;
+    else if (sel / priv->cols < (priv->nb_items - 1) / priv->cols)
+      sel = priv->nb_items - 1;
+    break;
+  default:
+    break;
+  }
+
+  if (sel == priv->sel)
+    return widget_action_default_cb (widget, ev);
+
+  grid_select (widget, sel);
+
+  return 0;
+}
+
+static SDL_Surface *
+grid_view_new (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  SDL_PixelFormat *fmt = omc->display->format;
+  SDL_Surface *view;
+
+  /* as wide as the widget, which it covers entirely */
+  view = SDL_CreateRGBSurface (SDL_SWSURFACE, widget->w,
+                               priv->rows * priv->cell_h, fmt->BitsPerPixel,
+                               fmt->Rmask, fmt->Gmask, fmt->Bmask, 0);
+  if (!view)
+    fprintf (stderr, "*** ERROR: %s\n", SDL_GetError ());
+
+  return view;
+}
+
+/* hidden, only the cells pool is kept */
+static void
+widget_grid_unload (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+  SDL_Surface *view = priv->view;
+  int i;
+
+  for (i = 0; i < priv->cols * priv->pool_rows; i++)
+    grid_cell_clear (priv, &priv->cells[i]);
+
+  priv->view = NULL;
+  display_lock ();
+  SDL_FreeSurface (view);
+  display_unlock ();
+}
+
+static void
+widget_grid_reload (widget_t *widget)
+{
+  widget_grid_t *priv = (widget_grid_t *) widget->priv;
+
+  if (!priv->view)
+    priv->view = grid_view_new (widget);
+
+  grid_update_cells (widget);
+  grid_paint_rows (widget, priv->top, priv->top + priv->rows);
+}
+
+static void
+widget_grid_free (widget_t *widget)
+{
+  widget_grid_t *priv;
+
+  if (!widget)
+    return;
+
+  priv = (widget_grid_t *) widget->priv;
+
+  widget_grid_unload (widget);
+  free (priv->cells);
+  free (priv);
+}
+
+widget_t *
+grid_new (char *id, widget_t *parent, int focusable, int show,
+          int layer, int cell_w, int cell_h,
+          int x, int y, int w, int h,
+          char *sx, char *sy, char *sw, char *sh)
+{
+  widget_t *widget = NULL;
+  widget_grid_t *priv = NULL;
+  int flags = WIDGET_FLAG_OPAQUE;
+  int x2, y2, w2, h2, i;
+
+  if (cell_w <= 2 * GRID_MARGIN || cell_h <= 2 * GRID_MARGIN)
+    return NULL;
+
+  if (show)
+    flags |= WIDGET_FLAG_SHOW;
+
+  if (focusable)
+    flags |= WIDGET_FLAG_FOCUSABLE;
+
+  x2 = sx ? compute_coord (sx, omc->w) : x;
+  y2 = sy ? compute_coord (sy, omc->h) : y;
+  w2 = sw ? compute_coord (sw, omc->w) : w;
+  h2 = sh ? compute_coord (sh, omc->h) : h;
+
+  if (w2 < cell_w || h2 <= 0)
+    return NULL;
+
+  widget = widget_new (id, WIDGET_TYPE_GRID, parent, flags, layer,
+                       x2, y2, w2, h2);
+
+  priv = calloc (1, sizeof (widget_grid_t));
+  priv->cell_w = cell_w;
+  priv->cell_h = cell_h;
+  priv->cols = w2 / cell_w;
+  priv->rows = (h2 + cell_h - 1) / cell_h;
+  priv->pool_rows = priv->rows + 2 * GRID_PREFETCH_ROWS;
+  priv->cells = calloc (priv->cols * priv->pool_rows, sizeof (grid_cell_t));
+  for (i = 0; i < priv->cols * priv->pool_rows; i++)
+  {
+    priv->cells[i].widget = widget;
+    priv->cells[i].index = -1;
+  }
+
+  widget->priv = priv;
+
+  widget->draw = widget_grid_draw;
+  widget->set_focus = widget_grid_set_focus;
+  widget->action = widget_grid_action;
+  widget->free = widget_grid_free;
+  widget->unload = widget_grid_unload;
+  widget->reload = widget_grid_reload;
+
+  priv->view = grid_view_new (widget);
+  grid_paint_rows (widget, 0, priv->rows);
+  grid_account (widget);
+
+  return widget;
+}
+
+/* item (data, i) gives the thumbnail file of the i-th item; it is only
+ * called for items about to be visible */
+void
+grid_set_items (widget_t *widget, int nb_items, grid_item_t item, void *data)
+{
+  widget_grid_t *priv;
+  int i;
+
+  if (!widget || widget->type != WIDGET_TYPE_GRID)
+    return;
+
+  priv = (widget_grid_t *) widget->priv;
+
+  for (i = 0; i < priv->cols * priv->pool_rows; i++)
+    grid_cell_clear (priv, &priv->cells[i]);
+
+  priv->nb_items = MAX (nb_items, 0);
+  priv->item = item;
+  priv->data = data;
+  priv->top = 0;
+  priv->sel = 0;
+
+  grid_update_cells (widget);
+  grid_paint_rows (widget, 0, priv->rows);
+}
+
+int
+grid_get_selection (widget_t *widget)
+{
+  if (!widget || widget->type != WIDGET_TYPE_GRID)
+    return -1;
+
+  return ((widget_grid_t *) widget->priv)->sel;
+}
+
+void
+grid_set_selection (widget_t *widget, int index)
+{
+  if (!widget || widget->type != WIDGET_TYPE_GRID)
+    return;
+
+  grid_select (widget, index);
+}
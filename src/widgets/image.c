@@ -24,21 +24,131 @@
 #include "omc.h"
 #include "widget.h"
 #include "display.h"
+#include "scale.h"
+#include "decode.h"
+#include "stats.h"
+#include "cache.h"
+#include "loader.h"
+#include "pack.h"
 
 typedef struct widget_image_s {
-  SDL_Surface *img;
+  picture_t *pic;       /* regular picture, shared through the image cache */
+  picture_t *fpic;      /* focused picture, NULL if none */
+  picture_t *cur;       /* the one being displayed */
+  loader_job_t *job;    /* pending loads of pic and fpic */
+  loader_job_t *fjob;
   char *name;           /* regular image */
   char *fname;          /* focused image */
+  int w, h;             /* requested size, <= 0 for original */
 } widget_image_t;
 
+typedef enum image_class {
+  IMAGE_OPAQUE,         /* every pixel is opaque */
+  IMAGE_BINARY,         /* pixels are either opaque or transparent */
+  IMAGE_ALPHA,          /* some pixels are translucent */
+} image_class_t;
+
+static const char *image_class_names[] = {
+  [IMAGE_OPAQUE] = "opaque",
+  [IMAGE_BINARY] = "colour keyed",
+  [IMAGE_ALPHA]  = "alpha",
+};
+
+/* colours tried as colour key, until one is unused by the image */
+static const Uint32 image_keys[] = {
+  0xff00ff, 0x00ff00, 0x0000ff, 0xff0000, 0x00ffff, 0xffff00,
+};
+
+/* colour comparison loose enough for a 15/16 bits display */
+#define KEY_MASK 0xf8f8f8
+
+static Uint32
+pixel_rgb (SDL_PixelFormat *fmt, Uint32 p)
+{
+  Uint8 r, g, b;
+
+  SDL_GetRGB (p, fmt, &r, &g, &b);
+  return (r << 16) | (g << 8) | b;
+}
+
+/* img is a 32 bits surface with an alpha channel, as given by
+ * SDL_DisplayFormatAlpha() */
+static image_class_t
+image_classify (SDL_Surface *img, Uint32 *key)
+{
+  SDL_PixelFormat *fmt = img->format;
+  int nb_keys = sizeof (image_keys) / sizeof (image_keys[0]);
+  int used[sizeof (image_keys) / sizeof (image_keys[0])] = { 0 };
+  int x, y, i, transparent = 0;
+
+  if (!fmt->Amask || fmt->BytesPerPixel != 4)
+    return IMAGE_ALPHA;
+
+  for (y = 0; y < img->h; y++)
+  {
+    Uint32 *p = (Uint32 *) ((Uint8 *) img->pixels + y * img->pitch);
+
+    for (x = 0; x < img->w; x++)
+    {
+      Uint32 a = p[x] & fmt->Amask;
+
+      if (a == 0)
+        transparent = 1;
+      else if (a != fmt->Amask)
+        return IMAGE_ALPHA;
+      else
+      {
+        Uint32 rgb = pixel_rgb (fmt, p[x]) & KEY_MASK;
+
+        for (i = 0; i < nb_keys; i++)
+          if (rgb == (image_keys[i] & KEY_MASK))
+            used[i] = 1;
+      }
+    }
+  }
+
+  if (!transparent)
+    return IMAGE_OPAQUE;
+
+  for (i = 0; i < nb_keys; i++)
+    if (!used[i])
+    {
+      *key = image_keys[i];
+      return IMAGE_BINARY;
+    }
+
+  /* every candidate key is in use, keep the alpha channel */
+  return IMAGE_ALPHA;
+}
+
+/* paints transparent pixels with the key and drops the alpha channel */
+static void
+image_apply_key (SDL_Surface *img, Uint32 key)
+{
+  SDL_PixelFormat *fmt = img->format;
+  Uint32 k;
+  int x, y;
+
+  k = SDL_MapRGBA (fmt, key >> 16, (key >> 8) & 0xff, key & 0xff, 0xff);
+
+  for (y = 0; y < img->h; y++)
+  {
+    Uint32 *p = (Uint32 *) ((Uint8 *) img->pixels + y * img->pitch);
+
+    for (x = 0; x < img->w; x++)
+      if (!(p[x] & fmt->Amask))
+        p[x] = k;
+  }
+
+  SDL_SetAlpha (img, 0, SDL_ALPHA_OPAQUE);
+}
+
+/* any format SDL_image knows, decoded as a whole then converted */
 static SDL_Surface *
-image_load (char *filename, int w, int h)
+image_decode (char *filename, int w, int h)
 {
   SDL_Surface *img, *img2;
 
-  if (!filename)
-    return NULL;
-  
   img = IMG_Load (filename);
   if (!img)
   {
@@ -47,7 +157,7 @@ image_load (char *filename, int w, int h)
   }
   printf ("Loaded a %d x %d image\n", img->w, img->h);
 
-  /* converts surface to display format once for all */
+  /* a common 32 bits format with alpha, whatever the file was */
   img2 = SDL_DisplayFormatAlpha (img);
   if (img2)
   {
@@ -55,54 +165,205 @@ image_load (char *filename, int w, int h)
     img = img2;
   }
   
-  if (w <= 0 || h <= 0)
-    return img;
+  if (w > 0 && h > 0 && (w != img->w || h != img->h))
+  {
+    /* scaling, SDL_gfx when it is faster or alpha conversion failed */
+    img2 = scale_accelerated () ? scale_surface (img, w, h, omc->filter)
+      : NULL;
+    if (!img2)
+      img2 = zoomSurface (img, (float) w / img->w, (float) h / img->h, 1);
+    if (img2)
+    {
+      printf ("Scaled to a %d x %d image\n", img2->w, img2->h);
+      SDL_FreeSurface (img);
+      img = img2;
+    }
+  }
 
-  /* scaling */
-  img2 = zoomSurface (img, (float) w / img->w, (float) h / img->h, 1);
-  if (!img2)
+  return img;
+}
+
+/* decodes for the image cache, see cache_load_t */
+SDL_Surface *
+image_load (char *filename, int w, int h, int *opaque)
+{
+  SDL_Surface *img, *img2;
+  image_class_t class;
+  Uint32 key = 0;
+
+  if (!filename)
+    return NULL;
+
+  /* already baked, nothing left to do */
+  img = pack_lookup (filename, w, h, opaque);
+  if (img)
     return img;
-  printf ("Scaled to a %d x %d image\n", img2->w, img2->h);
 
-  SDL_FreeSurface (img);
-  return img2;
+  /* PNG files are streamed to their final size and format */
+  img = decode_png (filename, w, h, omc->filter);
+  if (img)
+    printf ("Streamed a %d x %d image\n", img->w, img->h);
+  else
+    img = image_decode (filename, w, h);
+  if (!img)
+    return NULL;
+
+  /* classified once scaled, as smoothing adds translucent edges */
+  class = image_classify (img, &key);
+
+  /* converts surface to display format once for all, alpha blending
+   * is only kept for the images that really need it */
+  img2 = NULL;
+  switch (class)
+  {
+  case IMAGE_OPAQUE:
+    SDL_SetAlpha (img, 0, SDL_ALPHA_OPAQUE);
+    img2 = SDL_DisplayFormat (img);
+    break;
+  case IMAGE_BINARY:
+    image_apply_key (img, key);
+    img2 = SDL_DisplayFormat (img);
+    break;
+  case IMAGE_ALPHA:
+    break;
+  }
+
+  if (img2)
+  {
+    SDL_FreeSurface (img);
+    img = img2;
+  }
+
+  if (class == IMAGE_BINARY)
+    SDL_SetColorKey (img, SDL_SRCCOLORKEY | SDL_RLEACCEL,
+                     SDL_MapRGB (img->format, key >> 16,
+                                 (key >> 8) & 0xff, key & 0xff));
+
+  printf ("Using %s blits for %s\n", image_class_names[class], filename);
+  STATS_ADD (class == IMAGE_OPAQUE ? STATS_IMAGES_OPAQUE
+             : class == IMAGE_BINARY ? STATS_IMAGES_COLORKEY
+             : STATS_IMAGES_ALPHA, 1);
+
+  if (opaque)
+    *opaque = (class == IMAGE_OPAQUE);
+
+  return img;
 }
 
 static int
-widget_image_draw (widget_t *widget)
+widget_image_draw (widget_t *widget, SDL_Rect *area)
 {
   widget_image_t *priv = (widget_image_t *) widget->priv;
-  SDL_Rect dst;
+  picture_t *pic = priv->cur;
+  SDL_Rect dst, r;
 
-  if (!priv->img)
+  if (!pic)
     return -1;
 
-  dst.x = widget->x;
-  dst.y = widget->y;
-  dst.w = priv->img->w;
-  dst.h = priv->img->h;
-  
-  return surface_blit (widget, priv->img, dst);
+  /* where the whole surface would be, it may be an atlas page */
+  dst.x = widget->x - pic->rect.x;
+  dst.y = widget->y - pic->rect.y;
+  dst.w = pic->srf->w;
+  dst.h = pic->srf->h;
+
+  /* never bleed into the neighbours of the picture */
+  r.x = widget->x;
+  r.y = widget->y;
+  r.w = pic->rect.w;
+  r.h = pic->rect.h;
+  if (!rect_intersect (area, &r, &r))
+    return 0;
+
+  return surface_blit (widget, pic->srf, dst, &r);
 }
 
-static int
-widget_image_set_focus (struct widget_s *widget)
+static void
+image_show (widget_t *widget, picture_t *pic)
 {
   widget_image_t *priv = (widget_image_t *) widget->priv;
 
-  if (priv->img)
-    SDL_FreeSurface (priv->img);
+  priv->cur = pic;
 
-  if (widget_get_flag (widget, WIDGET_FLAG_FOCUSED))
-    priv->img = image_load (priv->name, widget->w, widget->h);
-  else
-    priv->img = image_load (priv->fname, widget->w, widget->h);
+  widget_set_flag (widget, WIDGET_FLAG_OPAQUE, pic->opaque);
 
-  if(!priv->img)
-    return 1;
+  /* the size seldom changes, as pictures are decoded at the requested
+   * one, so the redraw has to be asked for */
+  widget_set_rect (widget, widget->x, widget->y, pic->rect.w, pic->rect.h);
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+}
 
-  widget->w = priv->img->w;
-  widget->h = priv->img->h;
+/* both pictures are kept loaded, focus changes only swap them */
+static void
+image_update (widget_t *widget)
+{
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+  picture_t *pic = priv->pic;
+
+  if (widget_get_flag (widget, WIDGET_FLAG_FOCUSED) && priv->fpic)
+    pic = priv->fpic;
+
+  if (pic && pic != priv->cur)
+    image_show (widget, pic);
+}
+
+/* pictures may be shared, but are counted as if owned */
+static size_t
+image_bytes (widget_t *widget)
+{
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+  size_t bytes = 0;
+
+  if (priv->pic)
+    bytes += priv->pic->bytes;
+  if (priv->fpic)
+    bytes += priv->fpic->bytes;
+
+  return bytes;
+}
+
+static void
+image_set (widget_t *widget, picture_t **slot, picture_t *pic)
+{
+  picture_t *old = *slot;
+
+  if (!pic)
+    return;
+
+  *slot = pic;
+  image_update (widget);
+
+  /* the display thread may still be blitting the old one */
+  display_lock ();
+  cache_release (old);
+  display_unlock ();
+
+  widget_set_bytes (widget, image_bytes (widget));
+}
+
+static void
+image_loaded (void *data, picture_t *pic)
+{
+  widget_t *widget = (widget_t *) data;
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+
+  priv->job = NULL;
+  image_set (widget, &priv->pic, pic);
+}
+
+static void
+image_floaded (void *data, picture_t *pic)
+{
+  widget_t *widget = (widget_t *) data;
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+
+  priv->fjob = NULL;
+  image_set (widget, &priv->fpic, pic);
+}
+
+static int
+widget_image_set_focus (struct widget_s *widget)
+{
+  image_update (widget);
   
   return 0;
 }
@@ -113,6 +374,43 @@ widget_image_action (widget_t *widget, action_event_type_t ev)
   return widget_action_default_cb (widget, ev);
 }
 
+/* the widget is hidden, its pictures are handed back to the cache */
+static void
+widget_image_unload (widget_t *widget)
+{
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+  picture_t *pic = priv->pic, *fpic = priv->fpic;
+
+  loader_cancel (priv->job);
+  loader_cancel (priv->fjob);
+  priv->job = priv->fjob = NULL;
+  priv->pic = priv->fpic = priv->cur = NULL;
+
+  display_lock ();
+  cache_release (pic);
+  cache_release (fpic);
+  display_unlock ();
+}
+
+/* the widget stays empty until decoded, focused picture comes last */
+static void
+image_request (widget_t *widget, int priority)
+{
+  widget_image_t *priv = (widget_image_t *) widget->priv;
+
+  priv->job = loader_request (priv->name, priv->w, priv->h, priority,
+                              image_load, image_loaded, widget);
+  priv->fjob = loader_request (priv->fname, priv->w, priv->h,
+                               LOADER_PRIORITY_LOW,
+                               image_load, image_floaded, widget);
+}
+
+static void
+widget_image_reload (widget_t *widget)
+{
+  image_request (widget, LOADER_PRIORITY_HIGH);
+}
+
 static void
 widget_image_free (widget_t *widget)
 {
@@ -123,8 +421,13 @@ widget_image_free (widget_t *widget)
 
   priv = (widget_image_t *) widget->priv;
 
-  if (priv->img)
-    SDL_FreeSurface (priv->img);
+  loader_cancel (priv->job);
+  loader_cancel (priv->fjob);
+
+  display_lock ();
+  cache_release (priv->pic);
+  cache_release (priv->fpic);
+  display_unlock ();
 
   if (priv->name)
     free (priv->name);
@@ -144,6 +447,9 @@ image_new (char *id, widget_t *parent, int focusable, int show,
   widget_image_t *priv = NULL;
   int flags = WIDGET_FLAG_NONE;
   int x2, y2, w2, h2;
+
+  if (!name)
+    return NULL;
  
   if (show)
     flags |= WIDGET_FLAG_SHOW;
@@ -159,24 +465,24 @@ image_new (char *id, widget_t *parent, int focusable, int show,
   widget = widget_new (id, WIDGET_TYPE_IMAGE, parent, flags, layer,
                        x2, y2, w2, h2);
 
-  priv = malloc (sizeof (widget_image_t));
+  priv = calloc (1, sizeof (widget_image_t));
   printf ("Loading %s\n", name);
-  priv->name = name ? strdup (name) : NULL;
+  priv->name = strdup (name);
   priv->fname = fname ? strdup (fname) : NULL;
-  priv->img = image_load (priv->name, w2, h2);
+  priv->w = w2;
+  priv->h = h2;
 
-  if(!priv->img)
-    return NULL;
-
-  widget->w = priv->img->w;
-  widget->h = priv->img->h;
-  
   widget->priv = priv;
 
   widget->draw = widget_image_draw;
   widget->set_focus = widget_image_set_focus;
   widget->action = widget_image_action;
   widget->free = widget_image_free;
+  widget->unload = widget_image_unload;
+  widget->reload = widget_image_reload;
+
+  image_request (widget, show ? LOADER_PRIORITY_HIGH
+                 : LOADER_PRIORITY_NORMAL);
 
   return widget;
 }
@@ -190,17 +496,17 @@ image_set_picture (widget_t *widget, char *name)
     return;
   
   priv = (widget_image_t *) widget->priv;
-  
-  if (priv->img)
-    SDL_FreeSurface (priv->img);
-
-  priv->img = image_load (name, widget->w, widget->h);
 
-  if(!priv->img)
-    return;
+  /* kept for reloads */
+  if (priv->name != name)
+  {
+    free (priv->name);
+    priv->name = strdup (name);
+  }
 
-  widget->w = priv->img->w;
-  widget->h = priv->img->h;
-  
-  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+  /* the displayed picture is replaced once the new one is decoded */
+  loader_cancel (priv->job);
+  priv->job = loader_request (priv->name, priv->w, priv->h,
+                              LOADER_PRIORITY_HIGH,
+                              image_load, image_loaded, widget);
 }
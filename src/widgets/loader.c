@@ -0,0 +1,280 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "loader.h"
+
+/* Images are decoded by a few background threads, most urgent requests
+ * first. Results are handed back to the main thread, through an SDL
+ * user event, so that widgets are only ever updated from there. A
+ * cancelled job is dropped whatever state it is in, its callback is
+ * never called. With no thread, requests are served synchronously. */
+
+typedef enum job_state {
+  JOB_PENDING,          /* in the queue */
+  JOB_RUNNING,          /* being decoded */
+  JOB_DONE,             /* waiting for loader_dispatch() */
+} job_state_t;
+
+struct loader_job_s {
+  char *path;
+  int w, h;
+  int priority;
+  cache_load_t load;
+  loader_done_t done;
+  void *data;
+  picture_t *pic;
+  job_state_t state;
+  int cancelled;
+  struct loader_job_s *next;
+};
+
+static SDL_Thread **threads;
+static int nb_threads;
+
+static SDL_mutex *lock;
+static SDL_cond *cond;
+static loader_job_t *queue;     /* by priority, then request order */
+static loader_job_t *done;      /* decoded, not dispatched yet */
+static loader_job_t **done_tail = &done; /* completion order */
+static int quit;
+
+static void
+job_free (loader_job_t *job)
+{
+  cache_release (job->pic);
+  free (job->path);
+  free (job);
+}
+
+static void
+queue_insert (loader_job_t *job)
+{
+  loader_job_t **j;
+
+  for (j = &queue; *j; j = &(*j)->next)
+    if ((*j)->priority < job->priority)
+      break;
+
+  job->next = *j;
+  *j = job;
+}
+
+static void
+queue_remove (loader_job_t *job)
+{
+  loader_job_t **j;
+
+  for (j = &queue; *j; j = &(*j)->next)
+    if (*j == job)
+    {
+      *j = job->next;
+      break;
+    }
+}
+
+static int
+loader_worker (void *data)
+{
+  SDL_mutexP (lock);
+  while (1)
+  {
+    loader_job_t *job;
+
+    while (!quit && !queue)
+      SDL_CondWait (cond, lock);
+    if (quit)
+      break;
+
+    job = queue;
+    queue = job->next;
+    job->state = JOB_RUNNING;
+    SDL_mutexV (lock);
+
+    job->pic = cache_get (job->path, job->w, job->h, job->load);
+
+    SDL_mutexP (lock);
+    job->state = JOB_DONE;
+    job->next = NULL;
+    *done_tail = job;
+    done_tail = &job->next;
+
+    /* one event is enough for everything done meanwhile */
+    if (done == job)
+    {
+      SDL_Event ev;
+
+      ev.type = SDL_USEREVENT;
+      ev.user.code = LOADER_EVENT;
+      ev.user.data1 = NULL;
+      ev.user.data2 = NULL;
+      SDL_PushEvent (&ev);
+    }
+  }
+  SDL_mutexV (lock);
+
+  return 0;
+}
+
+void
+loader_init (int nb)
+{
+  int i;
+
+  lock = SDL_CreateMutex ();
+  cond = SDL_CreateCond ();
+
+  if (nb <= 0)
+    return;
+
+  threads = malloc (nb * sizeof (SDL_Thread *));
+  for (i = 0; i < nb; i++)
+  {
+    threads[nb_threads] = SDL_CreateThread (loader_worker, NULL);
+    if (threads[nb_threads])
+      nb_threads++;
+  }
+}
+
+void
+loader_uninit (void)
+{
+  int i;
+
+  if (!lock)
+    return;
+
+  SDL_mutexP (lock);
+  quit = 1;
+  SDL_CondBroadcast (cond);
+  SDL_mutexV (lock);
+
+  for (i = 0; i < nb_threads; i++)
+    SDL_WaitThread (threads[i], NULL);
+  free (threads);
+  threads = NULL;
+  nb_threads = 0;
+
+  while (queue)
+  {
+    loader_job_t *job = queue;
+    queue = job->next;
+    job_free (job);
+  }
+  while (done)
+  {
+    loader_job_t *job = done;
+    done = job->next;
+    job_free (job);
+  }
+  done_tail = &done;
+
+  SDL_DestroyCond (cond);
+  SDL_DestroyMutex (lock);
+  lock = NULL;
+}
+
+/* the returned job is valid until its callback is called or it gets
+ * cancelled; NULL is returned when it completed synchronously */
+loader_job_t *
+loader_request (char *path, int w, int h, int priority,
+                cache_load_t load, loader_done_t done_cb, void *data)
+{
+  loader_job_t *job;
+
+  picture_t *pic;
+
+  if (!path || !load || !done_cb)
+    return NULL;
+
+  /* nothing to wait for when already decoded */
+  pic = cache_get (path, w, h, nb_threads ? NULL : load);
+  if (pic || !nb_threads)
+  {
+    done_cb (data, pic);
+    return NULL;
+  }
+
+  job = calloc (1, sizeof (loader_job_t));
+  job->path = strdup (path);
+  job->w = w;
+  job->h = h;
+  job->priority = priority;
+  job->load = load;
+  job->done = done_cb;
+  job->data = data;
+  job->state = JOB_PENDING;
+
+  SDL_mutexP (lock);
+  queue_insert (job);
+  SDL_CondSignal (cond);
+  SDL_mutexV (lock);
+
+  return job;
+}
+
+void
+loader_cancel (loader_job_t *job)
+{
+  if (!job)
+    return;
+
+  SDL_mutexP (lock);
+  if (job->state == JOB_PENDING)
+  {
+    queue_remove (job);
+    SDL_mutexV (lock);
+    job_free (job);
+    return;
+  }
+
+  /* being decoded or waiting for dispatch, dropped from there */
+  job->cancelled = 1;
+  SDL_mutexV (lock);
+}
+
+void
+loader_dispatch (void)
+{
+  loader_job_t *list, *job;
+
+  SDL_mutexP (lock);
+  list = done;
+  done = NULL;
+  done_tail = &done;
+  SDL_mutexV (lock);
+
+  while (list)
+  {
+    job = list;
+    list = job->next;
+
+    if (!job->cancelled)
+    {
+      /* the callback takes over the picture reference */
+      job->done (job->data, job->pic);
+      job->pic = NULL;
+    }
+    job_free (job);
+  }
+}
@@ -0,0 +1,46 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include "cache.h"
+
+/* SDL_USEREVENT code telling the main loop to call loader_dispatch() */
+#define LOADER_EVENT 0x10ad
+
+#define LOADER_PRIORITY_LOW     0   /* not needed right now */
+#define LOADER_PRIORITY_NORMAL  1
+#define LOADER_PRIORITY_HIGH    2   /* visible on screen */
+
+typedef struct loader_job_s loader_job_t;
+
+/* called from the main thread, pic is NULL if decoding failed */
+typedef void (*loader_done_t) (void *data, picture_t *pic);
+
+void loader_init (int nb_threads);
+void loader_uninit (void);
+
+loader_job_t *loader_request (char *path, int w, int h, int priority,
+                              cache_load_t load, loader_done_t done,
+                              void *data);
+void loader_cancel (loader_job_t *job);
+void loader_dispatch (void);
+
+#endif /* _LOADER_H_ */
@@ -0,0 +1,537 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <SDL.h>
+
+#include "omc.h"
+#include "display.h"
+#include "pack.h"
+#include "cache.h"
+#include "stats.h"
+
+/* An asset pack holds images exactly as the image cache had them, i.e.
+ * decoded, scaled and converted to the display format. It is mapped at
+ * startup and its pixels are used in place. Entries are keyed like the
+ * cache, and are only used while their source file keeps the same
+ * modification time and size. The pack is only valid for the display
+ * format it was written with. Layout, in native byte order:
+ *   header, entries, paths, then pixels of each entry */
+
+#define PACK_MAGIC   "OMCPACK1"
+#define PACK_ALIGN   16
+
+typedef struct pack_header_s {
+  char magic[8];
+  uint32_t nb_entries;
+  uint32_t bpp;
+  uint32_t rmask, gmask, bmask, amask;
+} pack_header_t;
+
+typedef struct pack_entry_s {
+  uint64_t path;                /* offset of the NUL terminated path */
+  uint64_t data;                /* offset of the pixels */
+  int64_t mtime;                /* source file, when baked */
+  int64_t size;
+  int32_t req_w, req_h;         /* requested size, as in the cache */
+  uint32_t w, h, pitch;
+  uint32_t bpp;                 /* alpha images are not in display format */
+  uint32_t rmask, gmask, bmask, amask;
+  uint32_t flags;               /* SDL_SRCALPHA, SDL_SRCCOLORKEY */
+  uint32_t key;
+  uint32_t opaque;
+} pack_entry_t;
+
+static Uint8 *map;
+static size_t map_size;
+static pack_header_t *header;
+static pack_entry_t *entries;
+static int32_t *buckets;        /* first entry of each hash chain, or -1 */
+static int32_t *chains;         /* next entry in the same chain, or -1 */
+static uint32_t nb_buckets;
+static int stale;
+
+#define PACK_PAD(x) (((x) + PACK_ALIGN - 1) & ~((uint64_t) PACK_ALIGN - 1))
+
+static int
+pack_format_matches (pack_header_t *hdr)
+{
+  SDL_PixelFormat *fmt = omc->display->format;
+
+  return (hdr->bpp == fmt->BitsPerPixel
+          && hdr->rmask == fmt->Rmask && hdr->gmask == fmt->Gmask
+          && hdr->bmask == fmt->Bmask && hdr->amask == fmt->Amask);
+}
+
+static int
+pack_check (void)
+{
+  uint32_t i;
+
+  if (map_size < sizeof (pack_header_t)
+      || memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)))
+    return -1;
+
+  if (map_size < sizeof (pack_header_t)
+      + (uint64_t) header->nb_entries * sizeof (pack_entry_t))
+    return -1;
+
+  for (i = 0; i < header->nb_entries; i++)
+  {
+    pack_entry_t *e = &entries[i];
+
+    if (e->path >= map_size || !memchr (map + e->path, '\0',
+                                        map_size - e->path))
+      return -1;
+    if (e->bpp < 15 || e->bpp > 32
+        || e->pitch < e->w * ((e->bpp + 7) / 8)
+        || e->data + (uint64_t) e->h * e->pitch > map_size)
+      return -1;
+  }
+
+  return 0;
+}
+
+static unsigned int
+pack_hash (const char *path, int w, int h)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*path)
+    hash = (hash ^ (unsigned char) *path++) * 16777619u;
+  hash = (hash ^ w) * 16777619u;
+  hash = (hash ^ h) * 16777619u;
+
+  return hash % nb_buckets;
+}
+
+/* hash chains over the mapped entries, keyed like the cache */
+static int
+pack_index (void)
+{
+  uint32_t i;
+
+  nb_buckets = header->nb_entries ? header->nb_entries : 1;
+  buckets = malloc (nb_buckets * sizeof (*buckets));
+  chains = malloc ((header->nb_entries + 1) * sizeof (*chains));
+  if (!buckets || !chains)
+    return -1;
+
+  for (i = 0; i < nb_buckets; i++)
+    buckets[i] = -1;
+
+  for (i = 0; i < header->nb_entries; i++)
+  {
+    unsigned int hash = pack_hash ((char *) map + entries[i].path,
+                                   entries[i].req_w, entries[i].req_h);
+
+    chains[i] = buckets[hash];
+    buckets[hash] = i;
+  }
+
+  return 0;
+}
+
+static pack_entry_t *
+pack_find (char *path, int w, int h)
+{
+  int32_t i;
+
+  if (w <= 0 || h <= 0)
+    w = h = 0;
+
+  for (i = buckets[pack_hash (path, w, h)]; i >= 0; i = chains[i])
+    if (entries[i].req_w == w && entries[i].req_h == h
+        && !strcmp ((char *) map + entries[i].path, path))
+      return &entries[i];
+
+  return NULL;
+}
+
+/* whether the source file is still the one the entry was baked from */
+static int
+pack_entry_valid (pack_entry_t *e, char *path)
+{
+  struct stat st;
+
+  return (!stat (path, &st)
+          && e->mtime == st.st_mtime && e->size == st.st_size);
+}
+
+int
+pack_open (char *filename)
+{
+  struct stat st;
+  int fd;
+
+  stale = 1;
+
+  fd = open (filename, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat (fd, &st) < 0 || !st.st_size)
+  {
+    close (fd);
+    return -1;
+  }
+
+  /* private and writable, SDL never writes to blit sources anyway */
+  map_size = st.st_size;
+  map = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+  {
+    map = NULL;
+    return -1;
+  }
+
+  header = (pack_header_t *) map;
+  entries = (pack_entry_t *) (map + sizeof (pack_header_t));
+
+  if (pack_check () < 0)
+  {
+    fprintf (stderr, "*** ERROR: %s is not a valid pack\n", filename);
+    pack_close ();
+    return -1;
+  }
+
+  if (!pack_format_matches (header))
+  {
+    printf ("Pack %s was baked for another display format\n", filename);
+    pack_close ();
+    return -1;
+  }
+
+  if (pack_index () < 0)
+  {
+    fprintf (stderr, "*** ERROR: can't index pack %s\n", filename);
+    pack_close ();
+    return -1;
+  }
+
+  printf ("Using pack %s with %u images\n", filename, header->nb_entries);
+  stale = 0;
+
+  return 0;
+}
+
+void
+pack_close (void)
+{
+  if (map)
+    munmap (map, map_size);
+  map = NULL;
+  map_size = 0;
+  header = NULL;
+  entries = NULL;
+  free (buckets);
+  free (chains);
+  buckets = NULL;
+  chains = NULL;
+  nb_buckets = 0;
+}
+
+/* whether the pack is missing some image or has outdated ones */
+int
+pack_stale (void)
+{
+  return stale;
+}
+
+/* a surface using the mapped pixels, or NULL if not baked or outdated */
+SDL_Surface *
+pack_lookup (char *path, int w, int h, int *opaque)
+{
+  SDL_Surface *srf;
+  pack_entry_t *e;
+
+  if (!map || !path)
+    return NULL;
+
+  e = pack_find (path, w, h);
+  if (!e || !pack_entry_valid (e, path))
+  {
+    stale = 1;
+    return NULL;
+  }
+
+  srf = SDL_CreateRGBSurfaceFrom (map + e->data, e->w, e->h, e->bpp, e->pitch,
+                                  e->rmask, e->gmask, e->bmask, e->amask);
+  if (!srf)
+    return NULL;
+
+  if (e->flags & SDL_SRCCOLORKEY)
+    SDL_SetColorKey (srf, SDL_SRCCOLORKEY | SDL_RLEACCEL, e->key);
+  else if (!(e->flags & SDL_SRCALPHA))
+    SDL_SetAlpha (srf, 0, SDL_ALPHA_OPAQUE);
+
+  if (opaque)
+    *opaque = e->opaque;
+  STATS_ADD (STATS_IMAGES_PACKED, 1);
+
+  return srf;
+}
+
+/* valid entries of the mapped pack that pictures from list don't
+ * replace, as the cache may have dropped them meanwhile */
+static int
+pack_kept (picture_t **list, int n, pack_entry_t ***kept)
+{
+  char *replaced;
+  uint32_t i;
+  int j, nb = 0;
+
+  *kept = NULL;
+  if (!map || !header->nb_entries)
+    return 0;
+
+  replaced = calloc (header->nb_entries, 1);
+  *kept = malloc (header->nb_entries * sizeof (**kept));
+  if (!replaced || !*kept)
+  {
+    free (replaced);
+    free (*kept);
+    *kept = NULL;
+    return 0;
+  }
+
+  for (j = 0; j < n; j++)
+  {
+    pack_entry_t *e = pack_find (list[j]->path, list[j]->w, list[j]->h);
+
+    if (e)
+      replaced[e - entries] = 1;
+  }
+
+  for (i = 0; i < header->nb_entries; i++)
+    if (!replaced[i] && pack_entry_valid (&entries[i],
+                                          (char *) map + entries[i].path))
+      (*kept)[nb++] = &entries[i];
+
+  free (replaced);
+
+  return nb;
+}
+
+static int
+pack_pad (FILE *f)
+{
+  static const Uint8 zero[PACK_ALIGN];
+  long pad = PACK_PAD (ftell (f)) - ftell (f);
+
+  return (pad && fwrite (zero, pad, 1, f) != 1) ? -1 : 0;
+}
+
+static int
+pack_write_file (FILE *f, picture_t **list, int n,
+                 pack_entry_t **kept, int nb_kept)
+{
+  SDL_PixelFormat *fmt = omc->display->format;
+  pack_header_t hdr;
+  uint64_t path, offset;
+  int i, y;
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, PACK_MAGIC, sizeof (hdr.magic));
+  hdr.nb_entries = n + nb_kept;
+  hdr.bpp = fmt->BitsPerPixel;
+  hdr.rmask = fmt->Rmask;
+  hdr.gmask = fmt->Gmask;
+  hdr.bmask = fmt->Bmask;
+  hdr.amask = fmt->Amask;
+  if (fwrite (&hdr, sizeof (hdr), 1, f) != 1)
+    return -1;
+
+  /* paths right after the entries, pixels after the paths */
+  path = sizeof (hdr) + (uint64_t) hdr.nb_entries * sizeof (pack_entry_t);
+  offset = path;
+  for (i = 0; i < n; i++)
+    offset += strlen (list[i]->path) + 1;
+  for (i = 0; i < nb_kept; i++)
+    offset += strlen ((char *) map + kept[i]->path) + 1;
+  offset = PACK_PAD (offset);
+
+  for (i = 0; i < n; i++)
+  {
+    SDL_Surface *srf = list[i]->srf;
+    pack_entry_t e;
+    struct stat st;
+
+    memset (&e, 0, sizeof (e));
+    if (!stat (list[i]->path, &st))
+    {
+      e.mtime = st.st_mtime;
+      e.size = st.st_size;
+    }
+    e.path = path;
+    path += strlen (list[i]->path) + 1;
+    e.req_w = list[i]->w;
+    e.req_h = list[i]->h;
+    e.data = offset;
+    e.w = list[i]->rect.w;
+    e.h = list[i]->rect.h;
+    e.pitch = list[i]->page
+      ? e.w * srf->format->BytesPerPixel : (Uint32) srf->pitch;
+    e.bpp = srf->format->BitsPerPixel;
+    e.rmask = srf->format->Rmask;
+    e.gmask = srf->format->Gmask;
+    e.bmask = srf->format->Bmask;
+    e.amask = srf->format->Amask;
+    e.flags = srf->flags & (SDL_SRCALPHA | SDL_SRCCOLORKEY);
+    e.key = srf->format->colorkey;
+    e.opaque = list[i]->opaque;
+    offset = PACK_PAD (offset + (uint64_t) e.h * e.pitch);
+
+    if (fwrite (&e, sizeof (e), 1, f) != 1)
+      return -1;
+  }
+
+  /* kept entries only move */
+  for (i = 0; i < nb_kept; i++)
+  {
+    pack_entry_t e = *kept[i];
+
+    e.path = path;
+    path += strlen ((char *) map + kept[i]->path) + 1;
+    e.data = offset;
+    offset = PACK_PAD (offset + (uint64_t) e.h * e.pitch);
+
+    if (fwrite (&e, sizeof (e), 1, f) != 1)
+      return -1;
+  }
+
+  for (i = 0; i < n; i++)
+    if (fwrite (list[i]->path, strlen (list[i]->path) + 1, 1, f) != 1)
+      return -1;
+  for (i = 0; i < nb_kept; i++)
+  {
+    char *p = (char *) map + kept[i]->path;
+
+    if (fwrite (p, strlen (p) + 1, 1, f) != 1)
+      return -1;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    SDL_Surface *srf = list[i]->srf;
+    SDL_Rect *r = &list[i]->rect;
+    size_t len;
+    Uint8 *p;
+
+    if (pack_pad (f) < 0)
+      return -1;
+
+    /* only the part of an atlas page holding the picture */
+    len = list[i]->page ? r->w * srf->format->BytesPerPixel : srf->pitch;
+
+    if (SDL_MUSTLOCK (srf))
+      SDL_LockSurface (srf);
+    p = (Uint8 *) srf->pixels
+      + r->y * srf->pitch + r->x * srf->format->BytesPerPixel;
+    for (y = 0; y < r->h; y++)
+      if (fwrite (p + y * srf->pitch, len, 1, f) != 1)
+        break;
+    if (SDL_MUSTLOCK (srf))
+      SDL_UnlockSurface (srf);
+    if (y < r->h)
+      return -1;
+  }
+
+  for (i = 0; i < nb_kept; i++)
+  {
+    size_t len = (size_t) kept[i]->h * kept[i]->pitch;
+
+    if (pack_pad (f) < 0
+        || (len && fwrite (map + kept[i]->data, len, 1, f) != 1))
+      return -1;
+  }
+
+  return 0;
+}
+
+/* bakes every image from the cache, for the current display format,
+ * along with the still valid ones of the mapped pack */
+int
+pack_write (char *filename)
+{
+  picture_t **list;
+  pack_entry_t **kept;
+  char *tmp;
+  FILE *f;
+  int i, n, nb_kept, err;
+
+  n = cache_list (&list);
+
+  /* palettes are not stored, hardly any display uses them anyway */
+  for (i = 0; i < n; i++)
+    if (list[i]->srf->format->palette)
+    {
+      cache_release (list[i]);
+      list[i--] = list[--n];
+    }
+
+  nb_kept = pack_kept (list, n, &kept);
+
+  /* written aside then renamed, the old pack may still be mapped */
+  tmp = malloc (strlen (filename) + 5);
+  sprintf (tmp, "%s.tmp", filename);
+
+  f = fopen (tmp, "wb");
+  if (!f)
+  {
+    fprintf (stderr, "*** ERROR: can't write %s\n", tmp);
+    err = -1;
+  }
+  else
+  {
+    /* loaders may still be adding pictures to atlas pages */
+    display_lock ();
+    err = pack_write_file (f, list, n, kept, nb_kept);
+    display_unlock ();
+    if (fclose (f) || err)
+      err = -1;
+
+    if (!err && rename (tmp, filename) < 0)
+      err = -1;
+    if (err)
+    {
+      fprintf (stderr, "*** ERROR: can't write pack %s\n", filename);
+      unlink (tmp);
+    }
+    else
+      printf ("Baked %d images into %s, %d kept\n", n + nb_kept, filename,
+              nb_kept);
+  }
+
+  for (i = 0; i < n; i++)
+    cache_release (list[i]);
+  free (list);
+  free (kept);
+  free (tmp);
+
+  return err;
+}
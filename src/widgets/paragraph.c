@@ -0,0 +1,722 @@
+/* GeeXboX Open Media Center.
+ * Copyright (C) 2007 Benjamin Zores <ben@geexbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "omc.h"
+#include "widget.h"
+#include "display.h"
+#include "glyph.h"
+#include "font.h"
+
+/* Word wrapped text over several lines. Lines are only broken as far as
+ * they are shown, and only the visible ones are composited into a view
+ * surface, which scrolling moves instead of drawing everything again.
+ * Line breaks of recent texts are kept, keyed on text, font and width,
+ * and a new text or width is only broken again from the first line it
+ * may change. */
+
+#define PARAGRAPH_LAYOUTS  16   /* line breaks kept for texts not shown */
+#define PARAGRAPH_ELLIPSIS "..."
+
+/* line breaks of a text, as far as they have been computed */
+typedef struct layout_s {
+  char *str;
+  unsigned int hash;
+  char *file;           /* of the font */
+  int size, style;
+  int width;
+  glyph_line_t *lines;
+  int nb_lines;
+  struct layout_s *next; /* most recently used first */
+} layout_t;
+
+static layout_t *layouts; /* main thread only */
+
+/* line a row of the view shows */
+typedef struct paragraph_row_s {
+  int start;            /* -1 for none */
+  int len;
+  int ellipsis;
+} paragraph_row_t;
+
+typedef struct widget_paragraph_s {
+  font_t *font;         /* shared through the font registry */
+  SDL_Color color;
+  paragraph_align_t align;
+  int max_lines;        /* 0 for as many as the text needs */
+  char *str;
+  int len;
+  unsigned int hash;
+  glyph_line_t *lines;
+  int nb_lines;
+  int lines_size;
+  int done;             /* lines reach the end of the text */
+  SDL_Surface *view;    /* visible lines, as composited */
+  int rows;
+  paragraph_row_t *shown;
+  int top;              /* first visible line */
+  char *buf;            /* line being drawn */
+  int buf_size;
+} widget_paragraph_t;
+
+static unsigned int
+layout_hash (char *str)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*str)
+    hash = (hash ^ (Uint8) *str++) * 16777619u;
+
+  return hash;
+}
+
+static int
+layout_match (layout_t *layout, widget_paragraph_t *priv, int width)
+{
+  return layout->hash == priv->hash && layout->width == width
+    && layout->size == priv->font->size
+    && layout->style == priv->font->style
+    && !strcmp (layout->file, priv->font->file)
+    && !strcmp (layout->str, priv->str);
+}
+
+static void
+layout_free (layout_t *layout)
+{
+  free (layout->str);
+  free (layout->file);
+  free (layout->lines);
+  free (layout);
+}
+
+/* keeps the lines of the current text, for it to be shown again */
+static void
+layout_store (widget_paragraph_t *priv, int width)
+{
+  layout_t *layout, **l;
+  int n = 0;
+
+  if (!priv->str || !priv->nb_lines)
+    return;
+
+  for (l = &layouts; *l; l = &(*l)->next)
+    if (layout_match (*l, priv, width))
+    {
+      layout = *l;
+      *l = layout->next;
+      layout_free (layout);
+      break;
+    }
+
+  layout = calloc (1, sizeof (layout_t));
+  layout->str = strdup (priv->str);
+  layout->hash = priv->hash;
+  layout->file = strdup (priv->font->file);
+  layout->size = priv->font->size;
+  layout->style = priv->font->style;
+  layout->width = width;
+  layout->nb_lines = priv->nb_lines;
+  layout->lines = malloc (priv->nb_lines * sizeof (glyph_line_t));
+  memcpy (layout->lines, priv->lines, priv->nb_lines * sizeof (glyph_line_t));
+  layout->next = layouts;
+  layouts = layout;
+
+  /* least recently used ones are forgotten */
+  for (l = &layouts; *l;)
+    if (++n > PARAGRAPH_LAYOUTS)
+    {
+      layout = *l;
+      *l = layout->next;
+      layout_free (layout);
+    }
+    else
+      l = &(*l)->next;
+}
+
+static layout_t *
+layout_find (widget_paragraph_t *priv, int width)
+{
+  layout_t *layout, **l;
+
+  for (l = &layouts; *l; l = &(*l)->next)
+    if (layout_match (*l, priv, width))
+    {
+      layout = *l;
+      *l = layout->next;
+      layout->next = layouts;
+      layouts = layout;
+      return layout;
+    }
+
+  return NULL;
+}
+
+/* forgets the line breaks of all texts not shown */
+void
+paragraph_uninit (void)
+{
+  while (layouts)
+  {
+    layout_t *layout = layouts;
+
+    layouts = layout->next;
+    layout_free (layout);
+  }
+}
+
+static void
+paragraph_add_line (widget_paragraph_t *priv, glyph_line_t *line)
+{
+  if (priv->nb_lines == priv->lines_size)
+  {
+    priv->lines_size = priv->lines_size ? 2 * priv->lines_size : 16;
+    priv->lines =
+      realloc (priv->lines, priv->lines_size * sizeof (glyph_line_t));
+  }
+
+  priv->lines[priv->nb_lines++] = *line;
+}
+
+/* breaks lines until there are n of them, or the text ends */
+static void
+paragraph_wrap (widget_t *widget, int n)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+
+  while (!priv->done && priv->nb_lines < n)
+  {
+    glyph_line_t line;
+    int start = 0;
+
+    if (priv->nb_lines)
+      start = priv->lines[priv->nb_lines - 1].next;
+
+    if (start >= priv->len
+        || glyph_wrap (priv->font->glyphs, priv->str, start,
+                       widget->w, &line) < 0)
+    {
+      priv->done = 1;
+      break;
+    }
+
+    paragraph_add_line (priv, &line);
+  }
+}
+
+/* lines there is to show, broken as far as the view needs */
+static int
+paragraph_count (widget_t *widget)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  int n = priv->top + priv->rows;
+
+  if (priv->max_lines)
+    n = MIN (n, priv->max_lines);
+  paragraph_wrap (widget, n);
+
+  return priv->max_lines ? MIN (priv->nb_lines, priv->max_lines)
+    : priv->nb_lines;
+}
+
+/* Lines of the text are taken from the cache, else from the ones of old
+ * at old_width, up to the first one that may differ. */
+static void
+paragraph_reflow (widget_t *widget, char *old, int old_width)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  layout_t *layout;
+  int diff = INT_MAX, keep;
+
+  priv->done = 0;
+
+  layout = layout_find (priv, widget->w);
+  if (layout)
+  {
+    priv->nb_lines = 0;
+    for (keep = 0; keep < layout->nb_lines; keep++)
+      paragraph_add_line (priv, &layout->lines[keep]);
+    return;
+  }
+
+  if (!old)
+    diff = 0;
+  else if (strcmp (old, priv->str))
+    for (diff = 0; old[diff] == priv->str[diff]; diff++)
+      ;
+
+  for (keep = 0; keep < priv->nb_lines; keep++)
+  {
+    glyph_line_t *line = &priv->lines[keep];
+
+    /* lines that never looked as far as the first change are kept ... */
+    if (line->scan >= diff)
+      break;
+
+    /* ... as long as they still fit, and nothing more would */
+    if (widget->w != old_width
+        && (line->w > widget->w || widget->w >= line->overflow))
+      break;
+  }
+
+  priv->nb_lines = keep;
+}
+
+/* line i as drawn, with an ellipsis when it is the last one allowed and
+ * the text goes on */
+static char *
+paragraph_line_text (widget_t *widget, int i, int *ellipsis)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  glyph_line_t *line = &priv->lines[i];
+  int size, len;
+
+  *ellipsis = priv->max_lines && i == priv->max_lines - 1
+    && line->next < priv->len;
+
+  size = line->len + strlen (PARAGRAPH_ELLIPSIS) + 1;
+  if (size > priv->buf_size)
+  {
+    priv->buf = realloc (priv->buf, size);
+    priv->buf_size = size;
+  }
+  memcpy (priv->buf, priv->str + line->start, line->len);
+  priv->buf[line->len] = '\0';
+
+  if (*ellipsis)
+  {
+    /* words of the line the ellipsis still fits after */
+    strcpy (priv->buf + line->len, PARAGRAPH_ELLIPSIS);
+    len = glyph_fit (priv->font->glyphs, priv->buf, widget->w,
+                     PARAGRAPH_ELLIPSIS, NULL);
+    if (len >= 0 && priv->buf[len])
+      strcpy (priv->buf + len, PARAGRAPH_ELLIPSIS);
+  }
+
+  return priv->buf;
+}
+
+static void
+paragraph_paint_row (widget_t *widget, int row)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  glyph_cache_t *glyphs = priv->font->glyphs;
+  paragraph_row_t *shown = &priv->shown[row];
+  int i = priv->top + row;
+  SDL_Rect r, fill;
+  char *text = NULL;
+  int x = 0, w;
+
+  shown->start = -1;
+  shown->len = 0;
+  shown->ellipsis = 0;
+
+  if (!priv->view)
+    return;
+
+  if (i < paragraph_count (widget))
+  {
+    text = paragraph_line_text (widget, i, &shown->ellipsis);
+    shown->start = priv->lines[i].start;
+    shown->len = priv->lines[i].len;
+
+    glyph_size (glyphs, text, &w, NULL);
+    if (priv->align == PARAGRAPH_ALIGN_CENTER)
+      x = (priv->view->w - w) / 2;
+    else if (priv->align == PARAGRAPH_ALIGN_RIGHT)
+      x = priv->view->w - w;
+  }
+
+  r.x = 0;
+  r.y = row * glyphs->lineskip;
+  r.w = priv->view->w;
+  r.h = glyphs->lineskip;
+  fill = r;
+
+  display_lock ();
+  SDL_FillRect (priv->view, &fill, 0);
+  if (text)
+    glyph_draw (glyphs, text, priv->color, priv->view, x, r.y, &r);
+  display_unlock ();
+}
+
+static void
+paragraph_paint (widget_t *widget)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  int row;
+
+  for (row = 0; row < priv->rows; row++)
+    paragraph_paint_row (widget, row);
+
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+}
+
+/* after the text changed, only rows whose line did are drawn again */
+static void
+paragraph_update_rows (widget_t *widget, char *old)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  int lineskip = priv->font->glyphs->lineskip;
+  int row, count;
+
+  count = paragraph_count (widget);
+  for (row = 0; row < priv->rows; row++)
+  {
+    paragraph_row_t *shown = &priv->shown[row];
+    int i = priv->top + row;
+    SDL_Rect r;
+
+    if (i < count && shown->start >= 0)
+    {
+      glyph_line_t *line = &priv->lines[i];
+      int ellipsis = priv->max_lines && i == priv->max_lines - 1
+        && line->next < priv->len;
+
+      if (shown->len == line->len && shown->ellipsis == ellipsis
+          && !memcmp (old + shown->start, priv->str + line->start,
+                      line->len))
+      {
+        shown->start = line->start;
+        continue;
+      }
+    }
+    else if (i >= count && shown->start < 0)
+      continue;
+
+    paragraph_paint_row (widget, row);
+
+    r.x = widget->x;
+    r.y = widget->y + row * lineskip;
+    r.w = widget->w;
+    r.h = lineskip;
+    widget_invalidate (widget, r);
+  }
+}
+
+/* Moves the view by as many lines as top changes, then draws the ones
+ * that came in. Returns whether it moved. */
+static int
+paragraph_scroll_to (widget_t *widget, int top)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  SDL_Surface *view = priv->view;
+  int old = priv->top, d, row, count, rowbytes;
+
+  priv->top = MAX (top, 0);
+  count = paragraph_count (widget);
+  priv->top = MAX (MIN (priv->top, count - priv->rows), 0);
+  d = priv->top - old;
+  if (!d)
+    return 0;
+
+  if (!view || abs (d) >= priv->rows)
+  {
+    paragraph_paint (widget);
+    return 1;
+  }
+
+  rowbytes = priv->font->glyphs->lineskip * view->pitch;
+
+  display_lock ();
+  if (d > 0)
+  {
+    memmove (view->pixels, (Uint8 *) view->pixels + d * rowbytes,
+             (priv->rows - d) * rowbytes);
+    memmove (priv->shown, priv->shown + d,
+             (priv->rows - d) * sizeof (paragraph_row_t));
+  }
+  else
+  {
+    memmove ((Uint8 *) view->pixels - d * rowbytes, view->pixels,
+             (priv->rows + d) * rowbytes);
+    memmove (priv->shown - d, priv->shown,
+             (priv->rows + d) * sizeof (paragraph_row_t));
+  }
+  display_unlock ();
+
+  for (row = 0; row < abs (d); row++)
+    paragraph_paint_row (widget, d > 0 ? priv->rows - 1 - row : row);
+
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+
+  return 1;
+}
+
+static SDL_Surface *
+paragraph_view_new (widget_t *widget)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  SDL_Surface *view;
+
+  /* transparent, as text surfaces are */
+  view = SDL_CreateRGBSurface (SDL_SWSURFACE, widget->w,
+                               priv->rows * priv->font->glyphs->lineskip,
+                               32, 0x00FF0000, 0x0000FF00, 0x000000FF,
+                               0xFF000000);
+  if (!view)
+    fprintf (stderr, "*** ERROR: %s\n", SDL_GetError ());
+
+  widget_set_bytes (widget, view ? view->h * view->pitch : 0);
+
+  return view;
+}
+
+static void
+paragraph_view_free (widget_paragraph_t *priv)
+{
+  SDL_Surface *view = priv->view;
+
+  priv->view = NULL;
+
+  /* the display thread may still be blitting it */
+  display_lock ();
+  if (view)
+    SDL_FreeSurface (view);
+  display_unlock ();
+}
+
+static int
+widget_paragraph_draw (widget_t *widget, SDL_Rect *area)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+  SDL_Surface *view = priv->view;
+  SDL_Rect dst;
+
+  if (!view)
+    return -1;
+
+  dst.x = widget->x;
+  dst.y = widget->y;
+  dst.w = view->w;
+  dst.h = view->h;
+
+  return surface_blit (widget, view, dst, area);
+}
+
+static int
+widget_paragraph_set_focus (widget_t *widget)
+{
+  return 0;
+}
+
+/* scrolls by one line, focus only moves away from the first or last */
+static int
+widget_paragraph_action (widget_t *widget, action_event_type_t ev)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+
+  if (ev == ACTION_EVENT_GO_UP && paragraph_scroll_to (widget, priv->top - 1))
+    return 0;
+  if (ev == ACTION_EVENT_GO_DOWN
+      && paragraph_scroll_to (widget, priv->top + 1))
+    return 0;
+
+  return widget_action_default_cb (widget, ev);
+}
+
+/* hidden, only the line breaks are kept */
+static void
+widget_paragraph_unload (widget_t *widget)
+{
+  paragraph_view_free ((widget_paragraph_t *) widget->priv);
+}
+
+static void
+widget_paragraph_reload (widget_t *widget)
+{
+  widget_paragraph_t *priv = (widget_paragraph_t *) widget->priv;
+
+  if (!priv->view)
+    priv->view = paragraph_view_new (widget);
+  paragraph_paint (widget);
+}
+
+static void
+widget_paragraph_free (widget_t *widget)
+{
+  widget_paragraph_t *priv;
+
+  if (!widget)
+    return;
+
+  priv = (widget_paragraph_t *) widget->priv;
+
+  paragraph_view_free (priv);
+  font_release (priv->font);
+  free (priv->str);
+  free (priv->lines);
+  free (priv->shown);
+  free (priv->buf);
+  free (priv);
+}
+
+/* h <= 0 gets room for max_lines lines, or for the whole text when there
+ * is no such limit */
+widget_t *
+paragraph_new (char *id, widget_t *parent, int focusable, int show,
+               int layer, char *str, char *fontname, int size,
+               int r, int g, int b, paragraph_align_t align, int max_lines,
+               int x, int y, int w, int h,
+               char *sx, char *sy, char *sw, char *sh)
+{
+  widget_t *widget = NULL;
+  widget_paragraph_t *priv = NULL;
+  int flags = WIDGET_FLAG_NONE;
+  int x2, y2, w2, h2, lineskip, row;
+  font_t *font;
+
+  if (!str || !fontname)
+    return NULL;
+
+  if (show)
+    flags |= WIDGET_FLAG_SHOW;
+
+  if (focusable)
+    flags |= WIDGET_FLAG_FOCUSABLE;
+
+  x2 = sx ? compute_coord (sx, omc->w) : x;
+  y2 = sy ? compute_coord (sy, omc->h) : y;
+  w2 = sw ? compute_coord (sw, omc->w) : w;
+  h2 = sh ? compute_coord (sh, omc->h) : h;
+
+  /* lines are broken at the widget width */
+  if (w2 <= 0)
+    return NULL;
+
+  font = font_get (fontname, size, TTF_STYLE_NORMAL);
+  if (!font)
+    return NULL;
+  lineskip = MAX (font->glyphs->lineskip, 1);
+
+  widget = widget_new (id, WIDGET_TYPE_PARAGRAPH, parent, flags, layer,
+                       x2, y2, w2, MAX (h2, 0));
+
+  priv = calloc (1, sizeof (widget_paragraph_t));
+  priv->font = font;
+  priv->color.r = r;
+  priv->color.g = g;
+  priv->color.b = b;
+  priv->color.unused = 255;
+  priv->align = align;
+  priv->max_lines = MAX (max_lines, 0);
+  priv->str = strdup (str);
+  priv->len = strlen (str);
+  priv->hash = layout_hash (str);
+
+  widget->priv = priv;
+
+  paragraph_reflow (widget, NULL, w2);
+  if (h2 <= 0)
+  {
+    paragraph_wrap (widget, priv->max_lines ? priv->max_lines : INT_MAX);
+    h2 = MAX (priv->max_lines ? priv->max_lines : priv->nb_lines, 1)
+      * lineskip;
+    widget->h = h2;
+  }
+
+  priv->rows = (h2 + lineskip - 1) / lineskip;
+  priv->shown = malloc (priv->rows * sizeof (paragraph_row_t));
+  for (row = 0; row < priv->rows; row++)
+    priv->shown[row].start = -1;
+
+  widget->draw = widget_paragraph_draw;
+  widget->set_focus = widget_paragraph_set_focus;
+  widget->action = widget_paragraph_action;
+  widget->free = widget_paragraph_free;
+  widget->unload = widget_paragraph_unload;
+  widget->reload = widget_paragraph_reload;
+
+  priv->view = paragraph_view_new (widget);
+  paragraph_paint (widget);
+
+  return widget;
+}
+
+/* Only lines from the first one the change may affect are broken again,
+ * and only visible rows that changed are drawn. */
+void
+paragraph_set_str (widget_t *widget, char *str)
+{
+  widget_paragraph_t *priv;
+  char *old;
+
+  if (!widget || widget->type != WIDGET_TYPE_PARAGRAPH || !str)
+    return;
+
+  priv = (widget_paragraph_t *) widget->priv;
+
+  layout_store (priv, widget->w);
+
+  old = priv->str;
+  priv->str = strdup (str);
+  priv->len = strlen (str);
+  priv->hash = layout_hash (str);
+  paragraph_reflow (widget, old, widget->w);
+
+  /* the text may have got shorter than what was shown */
+  if (paragraph_scroll_to (widget, priv->top))
+    paragraph_paint (widget);
+  else
+    paragraph_update_rows (widget, old);
+
+  free (old);
+}
+
+/* Lines that still fit, with nothing more fitting, are kept. */
+void
+paragraph_set_width (widget_t *widget, int w)
+{
+  widget_paragraph_t *priv;
+  int old_width;
+
+  if (!widget || widget->type != WIDGET_TYPE_PARAGRAPH
+      || w <= 0 || w == widget->w)
+    return;
+
+  priv = (widget_paragraph_t *) widget->priv;
+
+  layout_store (priv, widget->w);
+
+  old_width = widget->w;
+  widget_set_rect (widget, widget->x, widget->y, w, widget->h);
+  paragraph_reflow (widget, priv->str, old_width);
+
+  if (priv->view)
+  {
+    paragraph_view_free (priv);
+    priv->view = paragraph_view_new (widget);
+  }
+  paragraph_scroll_to (widget, priv->top);
+  paragraph_paint (widget);
+}
+
+/* first visible line, kept within the text */
+void
+paragraph_scroll (widget_t *widget, int top)
+{
+  if (!widget || widget->type != WIDGET_TYPE_PARAGRAPH)
+    return;
+
+  paragraph_scroll_to (widget, top);
+}
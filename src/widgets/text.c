@@ -24,103 +24,199 @@
 #include "omc.h"
 #include "widget.h"
 #include "display.h"
+#include "glyph.h"
+#include "font.h"
+
+#define TEXT_ELLIPSIS "..."
 
 typedef struct widget_text_s {
   SDL_Surface *txt;     /* regular text */
   SDL_Color color;
   SDL_Color fcolor;
-  TTF_Font *font;
+  font_t *font;         /* shared through the font registry */
   char *str;
+  int ellipsis;         /* cut text ends with TEXT_ELLIPSIS */
+  int auto_w, auto_h;   /* widget sized after the text */
+  char *shown;          /* string txt has been drawn from */
+  int shown_size;
+  SDL_Color shown_color;
+  glyph_cache_t *shown_glyphs;
 } widget_text_t;
 
-static TTF_Font *
-font_load (char *filename, int size, int style)
+/* what the surface shows, for the next string to be compared with */
+static void
+text_keep (widget_text_t *priv, char *str, SDL_Color color,
+           glyph_cache_t *glyphs)
 {
-  TTF_Font *font;
+  int size = strlen (str) + 1;
 
-  font = TTF_OpenFont (filename, size);
-  if (!font)
+  if (size > priv->shown_size)
   {
-    fprintf(stderr, "*** ERROR: %s\n", SDL_GetError());
-    return NULL;
+    priv->shown = realloc (priv->shown, size);
+    priv->shown_size = size;
   }
-
-  TTF_SetFontStyle (font, style);
-
-  return font;
+  memcpy (priv->shown, str, size);
+  priv->shown_color = color;
+  priv->shown_glyphs = glyphs;
 }
 
+/* A surface of the same size as the current one gets drawn over, only
+ * where the new string differs from the one it shows, and is returned
+ * instead of a new one. changed gets the part that has been drawn. */
 static SDL_Surface *
-text_create (widget_t *widget, TTF_Font *font, char *str, SDL_Color color)
+text_create (widget_t *widget, glyph_cache_t *glyphs, char *str,
+             SDL_Color color, SDL_Rect *changed)
 {
-  SDL_Surface *txt;
-  char *tmp_str;
-  int w;
+  widget_text_t *priv = (widget_text_t *) widget->priv;
+  SDL_Surface *txt = priv->txt;
+  char *ellipsis = priv->ellipsis ? TEXT_ELLIPSIS : NULL;
+  char *tmp_str = str;
+  int len, w, h;
+
+  changed->w = 0;
+
+  /* cut to fit max width, only a cut string needs a copy */
+  len = glyph_fit (glyphs, str, widget->w, ellipsis, NULL);
+  if (len < 0)
+    return NULL;
+
+  if (str[len])
+  {
+    tmp_str = malloc (len + (ellipsis ? strlen (ellipsis) : 0) + 1);
+    memcpy (tmp_str, str, len);
+    strcpy (tmp_str + len, ellipsis ? ellipsis : "");
+  }
+
+  glyph_size (glyphs, tmp_str, &w, &h);
+  changed->x = 0;
+  changed->y = 0;
+  changed->w = w;
+  changed->h = h;
 
-  TTF_SizeText (font, str, &w, NULL);
-  if (widget->w > 0 && w > widget->w) /* need to clip to fit max width */
+  if (txt && txt->w == w && txt->h == h)
   {
-    int i;
-    
-    tmp_str = malloc (strlen (str));
+    SDL_Color *c = &priv->shown_color;
+    int x0, x1;
+
+    /* in the same colour and font, only the glyphs that changed or
+     * moved */
+    if (c->r == color.r && c->g == color.g && c->b == color.b
+        && priv->shown_glyphs == glyphs)
+    {
+      changed->w = 0;
+      if (glyph_diff (glyphs, priv->shown, tmp_str, &x0, &x1) > 0)
+      {
+        changed->x = MAX (x0, 0);
+        changed->w = MAX (MIN (x1, w) - changed->x, 0);
+      }
+    }
 
-    for (i = 0; i < strlen (str); i++)
+    /* the display thread must not blit it half drawn */
+    if (changed->w)
     {
-      tmp_str[i] = str[i];
-      tmp_str[i+1] = '\0';
-      TTF_SizeText (font, tmp_str, &w, NULL);
-      if (widget->w < w)
-        break;
+      SDL_Rect r = *changed;
+
+      display_lock ();
+      SDL_FillRect (txt, &r, 0);
+      glyph_draw (glyphs, tmp_str, color, txt, 0, 0, changed);
+      display_unlock ();
     }
   }
   else
-    tmp_str = strdup (str);
+    txt = glyph_render (glyphs, tmp_str, color);
 
-  txt = TTF_RenderUTF8_Blended (font, tmp_str, color);
-  if (!txt)
-  {
-    fprintf(stderr, "*** ERROR: %s\n", SDL_GetError());
+  if (txt)
+    text_keep (priv, tmp_str, color, glyphs);
+
+  if (tmp_str != str)
     free (tmp_str);
+
+  if (!txt)
     return NULL;
-  }
 
   if(!widget->w) widget->w = txt->w;
   if(!widget->h) widget->h = txt->h;
-  free (tmp_str);
-  
+
   return txt;
 }
 
 static int
-widget_text_draw (widget_t *widget)
+widget_text_draw (widget_t *widget, SDL_Rect *area)
 {
   widget_text_t *priv = (widget_text_t *) widget->priv;
+  SDL_Surface *txt = priv->txt;
   SDL_Rect dst;
 
+  if (!txt)
+    return -1;
+
   dst.x = widget->x;
   dst.y = widget->y;
-  dst.w = priv->txt->w;
-  dst.h = priv->txt->h;
+  dst.w = txt->w;
+  dst.h = txt->h;
   
-  return surface_blit (widget, priv->txt, dst);
+  return surface_blit (widget, txt, dst, area);
 }
 
-static int
-widget_text_set_focus (widget_t *widget)
+/* the display thread may still be blitting the old surface */
+static void
+text_swap (widget_text_t *priv, SDL_Surface *txt)
+{
+  SDL_Surface *old = priv->txt;
+
+  priv->txt = txt;
+
+  display_lock ();
+  if (old && old != txt)
+    SDL_FreeSurface (old);
+  display_unlock ();
+}
+
+static void
+text_set (widget_t *widget, SDL_Surface *txt)
+{
+  text_swap ((widget_text_t *) widget->priv, txt);
+  widget_set_bytes (widget, txt ? txt->h * txt->pitch : 0);
+}
+
+/* a surface drawn over only has its changed part redrawn */
+static void
+text_render (widget_t *widget)
 {
   widget_text_t *priv = (widget_text_t *) widget->priv;
+  SDL_Surface *old = priv->txt, *txt;
+  SDL_Color color;
+  SDL_Rect changed;
 
-  if (priv->txt)
-    SDL_FreeSurface (priv->txt);
+  color = widget_get_flag (widget, WIDGET_FLAG_FOCUSED) ?
+    priv->fcolor : priv->color;
+  txt = text_create (widget, priv->font->glyphs, priv->str, color, &changed);
+  text_set (widget, txt);
 
-  if (widget_get_flag (widget, WIDGET_FLAG_FOCUSED))
-    priv->txt = text_create (widget, priv->font, priv->str, priv->fcolor);
-  else
-    priv->txt = text_create (widget, priv->font, priv->str, priv->color);
+  if (txt != old)
+    widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+  else if (changed.w)
+  {
+    changed.x += widget->x;
+    changed.y += widget->y;
+    widget_invalidate (widget, changed);
+  }
+}
+
+static int
+widget_text_set_focus (widget_t *widget)
+{
+  text_render (widget);
   
   return 0;
 }
 
+static void
+widget_text_unload (widget_t *widget)
+{
+  text_swap ((widget_text_t *) widget->priv, NULL);
+}
+
 static int
 widget_text_action (widget_t *widget, action_event_type_t ev)
 {
@@ -137,11 +233,12 @@ widget_text_free (widget_t *widget)
 
   priv = (widget_text_t *) widget->priv;
 
-  if (priv->txt)
-    SDL_FreeSurface (priv->txt);
+  text_swap (priv, NULL);
 
-  if (priv->font)
-    TTF_CloseFont (priv->font);
+  font_release (priv->font);
+
+  if (priv->shown)
+    free (priv->shown);
 
   if (priv->str)
     free (priv->str);
@@ -180,7 +277,7 @@ text_new (char *id, widget_t *parent, int focusable, int show,
 
   priv = malloc (sizeof (widget_text_t));
   printf ("Loading \"%s\"\n", name);
-  priv->font = font_load (fontname, size, TTF_STYLE_NORMAL);
+  priv->font = font_get (fontname, size, TTF_STYLE_NORMAL);
 
   if(!priv->font)
     return NULL;
@@ -196,7 +293,13 @@ text_new (char *id, widget_t *parent, int focusable, int show,
   priv->fcolor.unused = 255;
   
   priv->str = strdup (name);
-  priv->txt = text_create (widget, priv->font, priv->str, priv->color);
+  priv->txt = NULL;
+  priv->ellipsis = 0;
+  priv->auto_w = !w2;
+  priv->auto_h = !h2;
+  priv->shown = NULL;
+  priv->shown_size = 0;
+  priv->shown_glyphs = NULL;
 
   widget->priv = priv;
 
@@ -204,6 +307,10 @@ text_new (char *id, widget_t *parent, int focusable, int show,
   widget->set_focus = widget_text_set_focus;
   widget->action = widget_text_action;
   widget->free = widget_text_free;
+  widget->unload = widget_text_unload;
+  widget->reload = text_render;
+
+  text_render (widget);
 
   return widget;
 }
@@ -212,20 +319,77 @@ void
 text_set_str (widget_t *widget, char *str)
 {
   widget_text_t *priv;
+  char *old;
 
   if (!widget || !str)
     return;
   
   priv = (widget_text_t *) widget->priv;
   str[strlen (str) - 1] = '\0';
-  
+
+  /* kept for focus changes and reloads */
+  old = priv->str;
+  priv->str = strdup (str);
+  free (old);
+
+  text_render (widget);
+}
+
+/* text too wide for the widget ends with an ellipsis instead of being
+ * cut on the last character that fits */
+void
+text_set_ellipsis (widget_t *widget, int state)
+{
+  widget_text_t *priv;
+
+  if (!widget || widget->type != WIDGET_TYPE_TEXT)
+    return;
+
+  priv = (widget_text_t *) widget->priv;
+  if (priv->ellipsis == !!state)
+    return;
+
+  priv->ellipsis = !!state;
   if (priv->txt)
-    SDL_FreeSurface (priv->txt);
+    text_render (widget);
+}
 
-  if (widget_get_flag (widget, WIDGET_FLAG_FOCUSED))
-    priv->txt = text_create (widget, priv->font, str, priv->fcolor);
-  else
-    priv->txt = text_create (widget, priv->font, str, priv->color);
-  
-  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+/* all digits take the same room, e.g. for a clock not to move around
+ * every second and only redraw the digits that changed */
+void
+text_set_tabular (widget_t *widget, int state)
+{
+  widget_text_t *priv;
+  font_t *font, *old;
+  int style;
+
+  if (!widget || widget->type != WIDGET_TYPE_TEXT)
+    return;
+
+  priv = (widget_text_t *) widget->priv;
+  old = priv->font;
+  style = state ? old->style | FONT_TABULAR : old->style & ~FONT_TABULAR;
+  if (style == old->style)
+    return;
+
+  font = font_get (old->file, old->size, style);
+  if (!font)
+    return;
+
+  priv->font = font;
+
+  /* sized after the text, e.g. digits may take more room now */
+  if (priv->auto_w || priv->auto_h)
+  {
+    int w, h;
+
+    glyph_size (font->glyphs, priv->str, &w, &h);
+    widget_set_rect (widget, widget->x, widget->y,
+                     priv->auto_w ? w : widget->w,
+                     priv->auto_h ? h : widget->h);
+  }
+
+  if (priv->txt)
+    text_render (widget);
+  font_release (old);
 }
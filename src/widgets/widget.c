@@ -20,9 +20,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <SDL_thread.h>
 
 #include "omc.h"
 #include "widget.h"
+#include "display.h"
+#include "stats.h"
+
+static void widget_budget_update (widget_t *widget);
 
 widget_t *
 widget_new (char *id, widget_type_t type, widget_t *parent, int flags,
@@ -49,13 +54,27 @@ widget_new (char *id, widget_type_t type, widget_t *parent, int flags,
   widget->redraw_area.y = 0;
   widget->redraw_area.h = 0;
   widget->redraw_area.w = 0;
+  widget->draw_area = widget->redraw_area;
+  widget->screen = NULL;
+  widget->dirty = 0;
+  widget->stack = 0;
+  widget->indexed = widget->redraw_area;
+  widget->stamp = 0;
   
+  widget->bytes = 0;
+  widget->unloaded = 0;
+  widget->hprev = NULL;
+  widget->hnext = NULL;
+
   widget->nb = NULL;
   widget->priv = NULL;
   widget->draw = NULL;
   widget->set_focus = NULL;
   widget->action = NULL;
   widget->free = NULL;
+  widget->unload = NULL;
+  widget->reload = NULL;
+  widget->tick = NULL;
 
   if (flags & WIDGET_FLAG_SHOW)
     widget->flags |= WIDGET_FLAG_NEED_REDRAW;
@@ -64,19 +83,19 @@ widget_new (char *id, widget_type_t type, widget_t *parent, int flags,
 }
 
 int
-widget_draw (widget_t *widget)
+widget_draw (widget_t *widget, SDL_Rect *area)
 {
-  if (!widget || !widget->draw)
+  if (!widget || !widget->draw || !area)
     return -1;
 
-  /* check if widget really needs to be redrawn */
-  if (!widget_get_flag (widget, WIDGET_FLAG_NEED_REDRAW))
+  /* hidden widgets are only redrawn by the ones underneath */
+  if (!widget_get_flag (widget, WIDGET_FLAG_SHOW))
     return -1;
-   
-  widget->draw (widget);
 
-  /* widget has been drawn */
-  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 0);
+  if (!area->w || !area->h)
+    return -1;
+   
+  widget->draw (widget, area);
   
   return 0;
 }
@@ -88,11 +107,12 @@ widget_show (widget_t *widget)
     return -1;
 
   /* show only makes sense when currently hidden */
-  if (!widget_get_flag (widget, WIDGET_FLAG_SHOW))
+  if (widget_get_flag (widget, WIDGET_FLAG_SHOW))
     return -1;
 
   /* show & trigger redraw */
   widget_set_flag (widget, WIDGET_FLAG_SHOW | WIDGET_FLAG_NEED_REDRAW, 1);
+  widget_budget_update (widget);
   
   return 0;
 }
@@ -104,11 +124,12 @@ widget_hide (widget_t *widget)
     return -1;
 
   /* hide only makes sense when currently shown */
-  if (widget_get_flag (widget, WIDGET_FLAG_SHOW))
+  if (!widget_get_flag (widget, WIDGET_FLAG_SHOW))
     return -1;
 
   widget_set_flag (widget, WIDGET_FLAG_SHOW, 0); /* hide */
   widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1); /* trigger redraw */
+  widget_budget_update (widget);
   
   return 0;
 }
@@ -134,6 +155,23 @@ widget_set_focus (widget_t *widget, int state)
   return -1;
 }
 
+void
+widget_set_layer (widget_t *widget, int layer)
+{
+  if (!widget || widget->layer == layer)
+    return;
+
+  /* let the layers currently underneath repaint the widget area */
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+
+  if (widget->screen)
+    screen_set_widget_layer (widget->screen, widget, layer);
+  else
+    widget->layer = layer;
+
+  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+}
+
 static widget_t * widget_get_neighbour (widget_t *widget,
                                         neighbours_type_t type);
 
@@ -208,10 +246,15 @@ widget_action (widget_t *widget, action_event_type_t ev)
 SDL_Rect
 widget_get_rect (widget_t *widget)
 {
+  SDL_Rect r = { 0, 0, 0, 0 };
+
   if (!widget)
-    return;
+    return r;
 
-  SDL_Rect r = { widget->x, widget->y, widget->w, widget->h };
+  r.x = widget->x;
+  r.y = widget->y;
+  r.w = widget->w;
+  r.h = widget->h;
 
   return r;
 }
@@ -231,44 +274,64 @@ widget_get_by_id (widget_t **list, char *id)
   return NULL;
 }
 
-static void
-widget_set_redraw_area (widget_t *widget, SDL_Rect area)
+void
+widget_set_rect (widget_t *widget, int x, int y, int w, int h)
 {
+  SDL_Rect r = { x, y, w, h };
+
   if (!widget)
     return;
 
-  SDL_mutexP (widget->lock);
-  widget->redraw_area.x = area.x;
-  widget->redraw_area.y = area.y;
-  widget->redraw_area.w = area.w;
-  widget->redraw_area.h = area.h;
-  SDL_mutexV (widget->lock);
-  
-  widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
-}
+  if (widget->x == x && widget->y == y && widget->w == w && widget->h == h)
+    return;
 
-#ifndef MAX
-#define MAX(a,b) ((a) > (b) ? (a) : (b))
-#endif
+  if (!widget->screen)
+  {
+    widget->x = x;
+    widget->y = y;
+    widget->w = w;
+    widget->h = h;
+  }
+  else
+  {
+    screen_move_widget (widget->screen, widget, &r);
+    widget_set_flag (widget, WIDGET_FLAG_NEED_REDRAW, 1);
+  }
 
-#ifndef MIN
-#define MIN(a,b) ((a) > (b) ? (b) : (a))
-#endif
+  /* may have been scrolled in or out of view */
+  widget_budget_update (widget);
+}
 
-static int
-shared_rect (SDL_Rect r1, SDL_Rect r2, SDL_Rect *area)
+/* Adds area to the part of the widget that has to be redrawn.
+ * Caller holds the screen lock. */
+void
+widget_set_redraw_area (widget_t *widget, SDL_Rect area)
 {
-  // check if the rectangles intersect
-  if( (r2.x + r2.w < r1.x) || (r2.x > r1.x + r1.w) ||
-      (r2.y + r2.h < r1.y) || (r2.y > r1.y + r1.h) )
-    return 0;
+  SDL_Rect r;
 
-  area->x = MAX(r1.x, r2.x);
-  area->y = MAX(r1.y, r2.y);
-  area->w = MIN(r1.x + r1.w, r2.x + r2.w) - area->x;
-  area->h = MIN(r1.y + r1.h, r2.y + r2.h) - area->y;
+  if (!widget || !widget->screen)
+    return;
 
-  return 1;
+  r = widget_get_rect (widget);
+  if (!rect_intersect (&area, &r, &area))
+    return;
+
+  widget->redraw_area = rect_union (&widget->redraw_area, &area);
+  screen_mark_dirty (widget->screen, widget);
+  STATS_ADD (STATS_INVALIDATIONS, 1);
+}
+
+/* Only area of the widget has to be drawn again, along with what lies
+ * underneath and what is stacked over it. */
+void
+widget_invalidate (widget_t *widget, SDL_Rect area)
+{
+  if (!widget || !widget->screen)
+    return;
+
+  /* the widget layer included */
+  screen_invalidate_area (widget->screen, area, widget->layer + 1);
+  screen_invalidate_above (widget->screen, widget, area);
 }
 
 int
@@ -279,7 +342,7 @@ widget_share_area (widget_t *w1, widget_t *w2, SDL_Rect *area)
   r1 = widget_get_rect (w1);
   r2 = widget_get_rect (w2);
 
-  return shared_rect (r1, r2, area);
+  return rect_intersect (&r1, &r2, area);
 }
 
 int
@@ -296,24 +359,17 @@ widget_set_flag (widget_t *widget, widget_flags_t f, int state)
   SDL_mutexV (widget->lock);
 
   /* special care for 'need redraw' flag */
-  if (omc->scr && widget_get_flag (widget, WIDGET_FLAG_NEED_REDRAW))
+  if (widget->screen && (f & WIDGET_FLAG_NEED_REDRAW) && state)
   {
-    widget_t **widgets;
-
-    /* for all widgets from screen ... */
-    for (widgets = omc->scr->wlist; *widgets; widgets++)
-    {
-      /* select those underneath the current widget ... */
-      if ((*widgets != widget) && (*widgets)->layer < widget->layer)
-      {
-        /* which share some display area with the current one ... */
-        SDL_Rect area;
-        if (widget_share_area (widget, *widgets, &area)
-            || widget_share_area (*widgets, widget, &area))
-          widget_set_redraw_area (*widgets, area);
-      }
-    }
-    
+    /* widget is redrawn as a whole ... */
+    screen_mark_dirty (widget->screen, widget);
+
+    /* ... on top of the lower layers parts it covers, and below what
+     * is stacked over it */
+    screen_invalidate_area (widget->screen,
+                            widget_get_rect (widget), widget->layer);
+    screen_invalidate_above (widget->screen, widget,
+                             widget_get_rect (widget));
   }
 
   return 1;
@@ -331,6 +387,189 @@ widget_get_flag (widget_t *widget, widget_flags_t f)
   return 0;
 }
 
+/* Widgets account for the memory of the surfaces they hold. Once they
+ * hold more than the budget, the ones that are hidden or out of view
+ * drop their pixels, least recently hidden first, and get them back,
+ * usually asynchronously, once visible again. Surfaces may be set from
+ * timer threads, but widgets are only unloaded from the main one, as
+ * image loads must be. */
+
+static SDL_mutex *budget_lock;
+static Uint32 budget_thread;    /* the main thread */
+static size_t budget = WIDGET_DEFAULT_BUDGET;
+static size_t total_bytes;
+static size_t hidden_bytes;
+static widget_t *hidden_head;   /* least recently hidden */
+static widget_t *hidden_tail;
+
+void
+widget_budget_init (size_t size)
+{
+  budget = size;
+  budget_lock = SDL_CreateMutex ();
+  budget_thread = SDL_ThreadID ();
+}
+
+void
+widget_budget_uninit (void)
+{
+  SDL_DestroyMutex (budget_lock);
+  budget_lock = NULL;
+}
+
+/* memory held by all widgets, and by the hidden ones */
+size_t
+widget_budget_bytes (size_t *hidden)
+{
+  if (hidden)
+    *hidden = hidden_bytes;
+
+  return total_bytes;
+}
+
+static int
+hidden_linked (widget_t *widget)
+{
+  return widget->hprev || hidden_head == widget;
+}
+
+static void
+hidden_unlink (widget_t *widget)
+{
+  if (!hidden_linked (widget))
+    return;
+
+  if (widget->hprev)
+    widget->hprev->hnext = widget->hnext;
+  else
+    hidden_head = widget->hnext;
+  if (widget->hnext)
+    widget->hnext->hprev = widget->hprev;
+  else
+    hidden_tail = widget->hprev;
+
+  widget->hprev = widget->hnext = NULL;
+  hidden_bytes -= widget->bytes;
+}
+
+static void
+hidden_append (widget_t *widget)
+{
+  widget->hprev = hidden_tail;
+  widget->hnext = NULL;
+  if (hidden_tail)
+    hidden_tail->hnext = widget;
+  else
+    hidden_head = widget;
+  hidden_tail = widget;
+
+  hidden_bytes += widget->bytes;
+}
+
+/* shown, and at least partly on screen and within its parent */
+static int
+widget_is_visible (widget_t *widget)
+{
+  SDL_Rect r, screen = { 0, 0, omc->w, omc->h };
+
+  if (!widget_get_flag (widget, WIDGET_FLAG_SHOW))
+    return 0;
+
+  r = widget_get_rect (widget);
+  if (!rect_intersect (&r, &screen, &r))
+    return 0;
+
+  if (widget->parent)
+  {
+    SDL_Rect p = widget_get_rect (widget->parent);
+    if (!rect_intersect (&r, &p, NULL))
+      return 0;
+  }
+
+  return 1;
+}
+
+static void
+widget_budget_evict (void)
+{
+  if (SDL_ThreadID () != budget_thread)
+    return;
+
+  while (1)
+  {
+    widget_t *widget;
+
+    SDL_mutexP (budget_lock);
+    widget = hidden_head;
+    if (!widget || total_bytes <= budget)
+    {
+      SDL_mutexV (budget_lock);
+      return;
+    }
+
+    hidden_unlink (widget);
+    total_bytes -= widget->bytes;
+    widget->bytes = 0;
+    widget->unloaded = 1;
+    SDL_mutexV (budget_lock);
+
+    widget->unload (widget);
+    STATS_ADD (STATS_WIDGETS_UNLOADED, 1);
+  }
+}
+
+/* to be called whenever the widget may have been shown or hidden */
+static void
+widget_budget_update (widget_t *widget)
+{
+  int visible, reload = 0;
+
+  if (!budget_lock || !widget->unload)
+    return;
+
+  visible = widget_is_visible (widget);
+
+  SDL_mutexP (budget_lock);
+  if (visible || !widget->bytes)
+    hidden_unlink (widget);
+  else if (!hidden_linked (widget))
+    hidden_append (widget);
+
+  if (visible && widget->unloaded)
+  {
+    widget->unloaded = 0;
+    reload = 1;
+  }
+  SDL_mutexV (budget_lock);
+
+  if (reload && widget->reload)
+  {
+    widget->reload (widget);
+    STATS_ADD (STATS_WIDGETS_RELOADED, 1);
+  }
+
+  widget_budget_evict ();
+}
+
+/* widgets tell how much memory their surfaces take */
+void
+widget_set_bytes (widget_t *widget, size_t bytes)
+{
+  if (!widget)
+    return;
+
+  SDL_mutexP (budget_lock);
+  total_bytes += bytes - widget->bytes;
+  if (hidden_linked (widget))
+    hidden_bytes += bytes - widget->bytes;
+  widget->bytes = bytes;
+  if (bytes)
+    widget->unloaded = 0;
+  SDL_mutexV (budget_lock);
+
+  widget_budget_update (widget);
+}
+
 static neighbours_t *
 neighbours_new (void)
 {
@@ -412,6 +651,9 @@ widget_free (widget_t *widget)
   if (!widget)
     return;
 
+  /* the display thread must not tick it anymore */
+  display_animate (widget, 0);
+
   if (widget->id)
     free (widget->id);
 
@@ -420,6 +662,12 @@ widget_free (widget_t *widget)
 
   if (widget->nb)
     neighbours_free (widget->nb);
+
+  SDL_mutexP (budget_lock);
+  hidden_unlink (widget);
+  total_bytes -= widget->bytes;
+  widget->bytes = 0;
+  SDL_mutexV (budget_lock);
   
   if (widget->free)
     widget->free (widget);
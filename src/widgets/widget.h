@@ -28,6 +28,9 @@ typedef enum widget_type {
   WIDGET_TYPE_UNKNOWN,
   WIDGET_TYPE_IMAGE,
   WIDGET_TYPE_TEXT,
+  WIDGET_TYPE_GRID,
+  WIDGET_TYPE_ANIM,
+  WIDGET_TYPE_PARAGRAPH,
 } widget_type_t;
 
 typedef enum widget_flags {
@@ -36,8 +39,12 @@ typedef enum widget_flags {
   WIDGET_FLAG_FOCUSABLE             = 0x02,
   WIDGET_FLAG_FOCUSED               = 0x04,
   WIDGET_FLAG_NEED_REDRAW           = 0x08,
+  WIDGET_FLAG_OPAQUE                = 0x10, /* hides what lies underneath */
 } widget_flags_t;
 
+/* surface memory all widgets may hold before hidden ones drop theirs */
+#define WIDGET_DEFAULT_BUDGET (64 * 1024 * 1024)
+
 typedef enum action_event_type {
   ACTION_EVENT_GO_UP,
   ACTION_EVENT_GO_DOWN,
@@ -49,6 +56,7 @@ typedef enum action_event_type {
 
 typedef struct widget_focus_s widget_focus_t;
 typedef struct neighbours_s neighbours_t;
+struct screen_s;
 
 typedef struct widget_s {
   char *id; /* unique identifier */
@@ -63,38 +71,65 @@ typedef struct widget_s {
   uint16_t h;
   uint8_t layer;
   SDL_Rect redraw_area; /* widget are that actually needs to be redrawn */
+  SDL_Rect draw_area;   /* area to be drawn by the display thread */
+
+  /* screen the widget has been added to */
+  struct screen_s *screen;
+  int dirty;            /* queued in screen dirty list */
+  int stack;            /* position within its layer, in drawing order */
+  SDL_Rect indexed;     /* geometry known by the screen spatial index */
+  unsigned int stamp;   /* last spatial query that reported the widget */
   
   /* neighbours list */
   neighbours_t *nb;
   struct widget_s *parent;
   
+  /* surface memory accounting, see widget_set_bytes() */
+  size_t bytes;
+  int unloaded;         /* pixels dropped, to be reloaded when visible */
+  struct widget_s *hprev, *hnext; /* hidden widgets holding pixels */
+
   /* widget type specific data */
   void *priv;
 
-  int (*draw) (struct widget_s *widget); /* called to draw widget */
+  /* called to draw the widget part within area */
+  int (*draw) (struct widget_s *widget, SDL_Rect *area);
   int (*set_focus) (struct widget_s *widget); /* called to set/unset focus */
   int (*action) (struct widget_s *widget, action_event_type_t ev);
   void (*free) (struct widget_s *widget); /* called to free widget */
+  void (*unload) (struct widget_s *widget); /* called to drop pixels */
+  void (*reload) (struct widget_s *widget); /* called to get them back */
+  /* called by the display thread, returns when next frame is due */
+  Uint32 (*tick) (struct widget_s *widget, Uint32 now);
 } widget_t;
 
 widget_t *widget_new (char *id, widget_type_t type, widget_t *parent, int flags, uint8_t layer,
                       uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
-int widget_draw (widget_t *widget);
+int widget_draw (widget_t *widget, SDL_Rect *area);
 int widget_show (widget_t *widget);
 int widget_hide (widget_t *widget);
 int widget_set_focus (widget_t *widget, int state);
+void widget_set_layer (widget_t *widget, int layer);
 int widget_action (widget_t *widget, action_event_type_t ev);
 void widget_free (widget_t *widget);
 
 int widget_action_default_cb (widget_t *widget, action_event_type_t ev);
 
 SDL_Rect widget_get_rect (widget_t *widget);
+void widget_set_rect (widget_t *widget, int x, int y, int w, int h);
+void widget_set_redraw_area (widget_t *widget, SDL_Rect area);
+void widget_invalidate (widget_t *widget, SDL_Rect area);
 widget_t *widget_get_by_id (widget_t **list, char *id);
 int widget_share_area (widget_t *w1, widget_t *w2, SDL_Rect *area);
 int widget_set_flag (widget_t *widget, widget_flags_t f, int state);
 int widget_get_flag (widget_t *widget, widget_flags_t f);
 
+void widget_budget_init (size_t budget);
+void widget_budget_uninit (void);
+size_t widget_budget_bytes (size_t *hidden);
+void widget_set_bytes (widget_t *widget, size_t bytes);
+
 struct neighbours_s {
   widget_t *up;
   widget_t *down;
@@ -119,6 +154,7 @@ widget_t *image_new (char *id, widget_t *parent, int focusable, int show,
                      int x, int y, int w, int h,
                      char *sx, char *sy, char *sw, char *sh);
 void image_set_picture (widget_t *widget, char *name);
+SDL_Surface *image_load (char *filename, int w, int h, int *opaque);
 
 widget_t *text_new (char *id, widget_t *parent, int focusable, int show,
                     int layer, char *name, char *fontname, int size,
@@ -126,5 +162,41 @@ widget_t *text_new (char *id, widget_t *parent, int focusable, int show,
                     int x, int y, int w, int h,
                     char *sx, char *sy, char *sw, char *sh);
 void text_set_str (widget_t *widget, char *str);
+void text_set_ellipsis (widget_t *widget, int state);
+void text_set_tabular (widget_t *widget, int state);
+
+/* path of the thumbnail of an item */
+typedef char *(*grid_item_t) (void *data, int index);
+
+widget_t *grid_new (char *id, widget_t *parent, int focusable, int show,
+                    int layer, int cell_w, int cell_h,
+                    int x, int y, int w, int h,
+                    char *sx, char *sy, char *sw, char *sh);
+void grid_set_items (widget_t *widget, int nb_items,
+                     grid_item_t item, void *data);
+int grid_get_selection (widget_t *widget);
+void grid_set_selection (widget_t *widget, int index);
+
+widget_t *anim_new (char *id, widget_t *parent, int show, int layer,
+                    char *name, int cols, int nb_frames, int delay,
+                    int x, int y, int w, int h,
+                    char *sx, char *sy, char *sw, char *sh);
+void anim_play (widget_t *widget, int play);
+
+typedef enum paragraph_align {
+  PARAGRAPH_ALIGN_LEFT,
+  PARAGRAPH_ALIGN_CENTER,
+  PARAGRAPH_ALIGN_RIGHT
+} paragraph_align_t;
+
+widget_t *paragraph_new (char *id, widget_t *parent, int focusable, int show,
+                         int layer, char *str, char *fontname, int size,
+                         int r, int g, int b, paragraph_align_t align,
+                         int max_lines, int x, int y, int w, int h,
+                         char *sx, char *sy, char *sw, char *sh);
+void paragraph_set_str (widget_t *widget, char *str);
+void paragraph_set_width (widget_t *widget, int w);
+void paragraph_scroll (widget_t *widget, int top);
+void paragraph_uninit (void);
 
 #endif /* _WIDGET_H_ */